@@ -0,0 +1,107 @@
+// GL/glut.h de mentira para medir los núcleos de rasterización sin ventana.
+// Las funciones de ventana y estado no hacen nada; los vértices van a un
+// sumidero que cuenta los píxeles que cubrirían y acumula una suma de control
+#ifndef MEDICION_GLUT_H
+#define MEDICION_GLUT_H
+
+typedef int GLint;
+typedef int GLsizei;
+typedef unsigned int GLenum;
+typedef unsigned int GLuint;
+typedef unsigned int GLbitfield;
+typedef unsigned char GLubyte;
+typedef float GLfloat;
+typedef double GLdouble;
+
+#define GL_POINTS            0x0000
+#define GL_QUADS             0x0007
+#define GL_INT               0x1404
+#define GL_UNSIGNED_BYTE     0x1401
+#define GL_VERTEX_ARRAY      0x8074
+#define GL_COLOR_ARRAY       0x8076
+#define GL_COLOR_BUFFER_BIT  0x4000
+#define GL_MODELVIEW         0x1700
+#define GL_PROJECTION        0x1701
+#define GLUT_RGB             0
+#define GLUT_DOUBLE          2
+#define GLUT_LEFT_BUTTON     0
+#define GLUT_RIGHT_BUTTON    2
+#define GLUT_DOWN            0
+
+// Estado del sumidero. En GL_POINTS cada vértice cubre tamanoPunto² píxeles;
+// en GL_QUADS cada cuatro vértices son un tramo de 1 px de alto (SumideroGL::tramo).
+// `vivos` consume cada coordenada para que el compilador no pueda descartar
+// su cálculo; con `conSuma` se acumula además una suma FNV-1a en orden
+struct SumideroPixeles {
+    unsigned long long pixeles;
+    unsigned long long suma;
+    unsigned vivos;
+    bool conSuma;
+    GLenum modo;
+    int tamanoPunto;
+    int verticeQuad;
+    int xQuad;
+};
+
+static SumideroPixeles sumidero = {0, 0, 0, false, GL_POINTS, 1, 0, 0};
+
+inline void contarVertice(GLint x, GLint y) {
+    sumidero.vivos += (unsigned) x ^ (unsigned) y;
+    if (sumidero.conSuma) {
+        sumidero.suma ^= (unsigned long long) (unsigned) x << 32 | (unsigned) y;
+        sumidero.suma *= 1099511628211ULL;
+    }
+    if (sumidero.modo == GL_POINTS) {
+        sumidero.pixeles += (unsigned long long) sumidero.tamanoPunto * sumidero.tamanoPunto;
+    } else {
+        if (sumidero.verticeQuad == 0) sumidero.xQuad = x;
+        else if (sumidero.verticeQuad == 1) sumidero.pixeles += x - sumidero.xQuad;
+        sumidero.verticeQuad = (sumidero.verticeQuad + 1) & 3;
+    }
+}
+
+inline void glBegin(GLenum modo) {
+    sumidero.modo = modo;
+    sumidero.verticeQuad = 0;
+}
+inline void glEnd() {}
+inline void glVertex2i(GLint x, GLint y) { contarVertice(x, y); }
+inline void glPointSize(GLfloat t) { sumidero.tamanoPunto = (int) t; }
+
+// SumideroGL::coordenadas envía los puntos con glDrawArrays
+static const GLint *verticesSumidero = 0;
+inline void glEnableClientState(GLenum) {}
+inline void glDisableClientState(GLenum) {}
+inline void glVertexPointer(GLint, GLenum, GLsizei, const void *p) { verticesSumidero = (const GLint *) p; }
+inline void glColorPointer(GLint, GLenum, GLsizei, const void *) {}
+inline void glDrawArrays(GLenum modo, GLint primero, GLsizei n) {
+    glBegin(modo);
+    for (GLsizei i = primero; i < primero + n; i++) contarVertice(verticesSumidero[2 * i], verticesSumidero[2 * i + 1]);
+}
+
+inline void glColor3f(GLfloat, GLfloat, GLfloat) {}
+inline void glColor3ubv(const GLubyte *) {}
+inline void glClear(GLbitfield) {}
+inline void glClearColor(GLfloat, GLfloat, GLfloat, GLfloat) {}
+inline void glMatrixMode(GLenum) {}
+inline void glLoadIdentity() {}
+inline void glViewport(GLint, GLint, GLsizei, GLsizei) {}
+inline void gluOrtho2D(GLdouble, GLdouble, GLdouble, GLdouble) {}
+
+inline void glutInit(int *, char **) {}
+inline void glutInitDisplayMode(unsigned int) {}
+inline void glutInitWindowSize(int, int) {}
+inline int glutCreateWindow(const char *) { return 1; }
+inline void glutDisplayFunc(void (*)()) {}
+inline void glutReshapeFunc(void (*)(int, int)) {}
+inline void glutMouseFunc(void (*)(int, int, int, int)) {}
+inline int glutCreateMenu(void (*)(int)) { return 1; }
+inline void glutAddMenuEntry(const char *, int) {}
+inline void glutAddSubMenu(const char *, int) {}
+inline void glutAttachMenu(int) {}
+inline void glutPostRedisplay() {}
+inline void glutSetWindowTitle(const char *) {}
+inline void glutSwapBuffers() {}
+inline void glutMainLoop() {}
+
+#endif
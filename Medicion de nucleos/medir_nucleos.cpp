@@ -0,0 +1,218 @@
+// Mide los núcleos de rasterización sin ventana ni GL. Las partes 1 a 3 se
+// incluyen tal cual en su propio espacio de nombres y el GL/glut.h de esta
+// carpeta hace de sumidero que cuenta los píxeles. La parte 4 dibuja con los
+// algoritmos de Rasterizador/, que se miden directamente como parte 0.
+//
+// Salida: una fila por caso separada por tabuladores, con cabecera:
+//   parte nucleo caso repeticiones pixeles ns_por_pixel mpixeles_por_s suma
+// `caso` va como clave=valor separados por comas y `suma` es una suma de
+// control de los vértices emitidos: si cambia, el núcleo dibuja otra cosa.
+// Los núcleos de la parte 0 aparecen dos veces: con /gl pasan por SumideroGL
+// y este GL/glut.h, como las partes; con /contador van a SumideroContador,
+// que no emite vértices y por eso no tiene suma.
+//
+// Uso: medir_nucleos [--ms N] [--parte N]
+#include <GL/glut.h>
+#include "../Rasterizador/rasterizador.h"
+#include "../Rasterizador/sumidero_gl.h"
+
+// Cabeceras que incluyen las partes; se cargan aquí, fuera de los espacios
+// de nombres, para que dentro de ellos sus guardas las dejen vacías
+#include <cmath>
+#include <vector>
+#include <deque>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <climits>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <dirent.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
+
+namespace parte1 {
+#define main main_parte1
+#include "../Proyecto de Unidad_parte1/main.cpp"
+#undef main
+}
+
+namespace parte2 {
+#define main main_parte2
+#include "../Proyecto de Unidad_parte2/main.cpp"
+#undef main
+}
+
+namespace parte3 {
+#define main main_parte3
+#include "../Proyecto de Unidad_parte3/main.cpp"
+#undef main
+}
+
+using namespace std;
+
+double msMinimo = 20;
+int soloParte = -1;
+SumideroContador contador;
+
+// Una pasada con suma de control y después se repite dibujar() duplicando
+// las repeticiones hasta que tarde al menos msMinimo
+template <class F>
+void medir(int parte, const char *nucleo, const string &caso, F dibujar) {
+    if (soloParte >= 0 && soloParte != parte) return;
+    sumidero.pixeles = 0;
+    sumidero.suma = 14695981039346656037ULL;
+    sumidero.conSuma = true;
+    contador.pixeles = 0;
+    dibujar();
+    sumidero.conSuma = false;
+    unsigned long long pixeles = sumidero.pixeles + contador.pixeles, suma = sumidero.suma;
+    char textoSuma[17] = "-";
+    if (contador.pixeles == 0) snprintf(textoSuma, sizeof(textoSuma), "%016llx", suma);
+
+    long repeticiones = 1;
+    double ms;
+    while (true) {
+        auto t0 = chrono::steady_clock::now();
+        for (long i = 0; i < repeticiones; i++) dibujar();
+        ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+        if (ms >= msMinimo || repeticiones >= (1L << 30)) break;
+        repeticiones *= 2;
+    }
+    double nsPorPixel = pixeles ? ms * 1e6 / ((double) pixeles * repeticiones) : 0;
+    printf("%d\t%s\t%s\t%ld\t%llu\t%.3f\t%.1f\t%s\n", parte, nucleo, caso.c_str(), repeticiones,
+           pixeles, nsPorPixel, nsPorPixel > 0 ? 1e3 / nsPorPixel : 0, textoSuma);
+    fflush(stdout);
+}
+
+typedef void (*NucleoLinea)(int, int, int, int, int);
+
+// Cada repetición dibuja las cuatro reflexiones de la línea desde el origen,
+// para recorrer todos los cuadrantes con la misma pendiente
+void medirLineas(int parte, const char *nucleo, NucleoLinea dibujarLinea) {
+    const int largos[] = {8, 64, 512, 4096};
+    const int angulos[] = {0, 15, 30, 45, 60, 75, 90};
+    for (int largo : largos)
+        for (int angulo : angulos) {
+            double a = angulo * M_PI / 180;
+            int dx = (int) floor(largo * cos(a) + 0.5), dy = (int) floor(largo * sin(a) + 0.5);
+            char caso[64];
+            snprintf(caso, sizeof(caso), "largo=%d,angulo=%d", largo, angulo);
+            medir(parte, nucleo, caso, [=]() {
+                dibujarLinea(0, 0, dx, dy, 1);
+                dibujarLinea(0, 0, -dx, dy, 1);
+                dibujarLinea(0, 0, dx, -dy, 1);
+                dibujarLinea(0, 0, -dx, -dy, 1);
+            });
+        }
+}
+
+typedef void (*NucleoElipse)(int, int, int, int);
+
+void medirCirculos(int parte, const char *nucleo, NucleoElipse dibujarElipse) {
+    const int radios[] = {4, 16, 64, 256, 1024};
+    for (int r : radios) {
+        char caso[64];
+        snprintf(caso, sizeof(caso), "r=%d", r);
+        medir(parte, nucleo, caso, [=]() { dibujarElipse(0, 0, r, r); });
+    }
+}
+
+// Semieje mayor hasta 512, con ambas orientaciones por caso
+void medirElipses(int parte, const char *nucleo, NucleoElipse dibujarElipse) {
+    const int semiejes[] = {16, 128, 512};
+    const int proporciones[] = {100, 50, 25, 10};     // semieje menor, % del mayor
+    for (int a : semiejes)
+        for (int p : proporciones) {
+            int b = max(1, a * p / 100);
+            char caso[64];
+            snprintf(caso, sizeof(caso), "a=%d,b=%d", a, b);
+            medir(parte, nucleo, caso, [=]() {
+                dibujarElipse(0, 0, a, b);
+                dibujarElipse(0, 0, b, a);
+            });
+        }
+}
+
+// Un núcleo de la biblioteca con los dos sumideros
+#define MEDIR_LINEAS_BIBLIOTECA(nucleo) \
+    medirLineas(0, #nucleo "/gl", [](int x0, int y0, int x1, int y1, int g) { \
+        SumideroGL s; \
+        nucleo(s, x0, y0, x1, y1, g); \
+    }); \
+    medirLineas(0, #nucleo "/contador", [](int x0, int y0, int x1, int y1, int g) { \
+        nucleo(contador, x0, y0, x1, y1, g); \
+    })
+
+// `llamada` usa s, cx, cy, rx y ry; en los círculos rx es el radio
+#define MEDIR_ELIPSES_BIBLIOTECA(medirCon, nombre, llamada) \
+    medirCon(0, nombre "/gl", [](int cx, int cy, int rx, int ry) { \
+        SumideroGL s; \
+        (void) ry; \
+        llamada; \
+    }); \
+    medirCon(0, nombre "/contador", [](int cx, int cy, int rx, int ry) { \
+        SumideroContador &s = contador; \
+        (void) ry; \
+        llamada; \
+    })
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--ms") == 0 && i + 1 < argc) msMinimo = atof(argv[++i]);
+        else if (strcmp(argv[i], "--parte") == 0 && i + 1 < argc) soloParte = atoi(argv[++i]);
+        else {
+            fprintf(stderr, "Uso: %s [--ms N] [--parte N]\n", argv[0]);
+            return 2;
+        }
+    }
+    printf("parte\tnucleo\tcaso\trepeticiones\tpixeles\tns_por_pixel\tmpixeles_por_s\tsuma\n");
+
+    medirLineas(1, "drawLineDirect", parte1::drawLineDirect);
+    medirLineas(2, "drawDirectLine", parte2::drawDirectLine);
+    medirLineas(2, "drawDDALine", parte2::drawDDALine);
+    medirLineas(3, "drawLineDirect", parte3::drawLineDirect);
+    medirLineas(3, "drawLineDDA", parte3::drawLineDDA);
+    MEDIR_LINEAS_BIBLIOTECA(rasterizarLineaDirecta);
+    MEDIR_LINEAS_BIBLIOTECA(rasterizarLineaDDA);
+    MEDIR_LINEAS_BIBLIOTECA(rasterizarLineaBresenham);
+    MEDIR_LINEAS_BIBLIOTECA(rasterizarLineaDDAFijo);
+    medirLineas(0, "rasterizarTrazoLinea(3)/gl", [](int x0, int y0, int x1, int y1, int) {
+        SumideroGL s;
+        rasterizarTrazoLinea(s, x0, y0, x1, y1, 3);
+    });
+    medirLineas(0, "rasterizarTrazoLinea(3)/contador", [](int x0, int y0, int x1, int y1, int) {
+        rasterizarTrazoLinea(contador, x0, y0, x1, y1, 3);
+    });
+
+    medirCirculos(3, "drawCircleMidpoint", [](int cx, int cy, int r, int) {
+        parte3::drawCircleMidpoint(cx, cy, r, 1);
+    });
+    MEDIR_ELIPSES_BIBLIOTECA(medirCirculos, "rasterizarCirculo", rasterizarCirculo(s, cx, cy, rx, 1));
+    MEDIR_ELIPSES_BIBLIOTECA(medirCirculos, "rasterizarCirculoRelleno", rasterizarCirculoRelleno(s, cx, cy, rx));
+
+    medirElipses(3, "drawEllipseMidpoint", [](int cx, int cy, int rx, int ry) {
+        parte3::drawEllipseMidpoint(cx, cy, rx, ry, 1);
+    });
+    MEDIR_ELIPSES_BIBLIOTECA(medirElipses, "rasterizarElipse", rasterizarElipse(s, cx, cy, rx, ry, 1));
+    MEDIR_ELIPSES_BIBLIOTECA(medirElipses, "rasterizarElipseRellena", rasterizarElipseRellena(s, cx, cy, rx, ry));
+    MEDIR_ELIPSES_BIBLIOTECA(medirElipses, "rasterizarTrazoElipse(3)", rasterizarTrazoElipse(s, cx, cy, rx, ry, 3));
+    return 0;
+}
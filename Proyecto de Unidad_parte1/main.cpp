@@ -1,4 +1,6 @@
 #include <GL/glut.h>
+#include "../Rasterizador/rasterizador.h"
+#include "../Rasterizador/sumidero_gl.h"
 #include <cmath>
 #include <vector>
 #include <iostream>
@@ -29,50 +31,10 @@ int activeThickness = 1;
 bool waitingForSecondClick = false;
 int xFirstClick = 0, yFirstClick = 0;
 
-inline int roundToInt(float v) {
-    return static_cast<int>(floor(v + 0.5f));
-}
-
-// Pinta un pixel en coordenadas (x,y)
-void drawPixel(int x, int y) {
-    glVertex2i(x, y);
-}
-
 // Algoritmo de lnea directa dibujando puntos
 void drawLineDirect(int x0, int y0, int x1, int y1, int thickness) {
-    int deltaX = x1 - x0;
-    int deltaY = y1 - y0;
-
-    glPointSize(thickness);
-    glBegin(GL_POINTS);
-
-    if (deltaX == 0) {
-        int step = (y1 > y0) ? 1 : -1;
-        for (int y = y0; y != y1 + step; y += step) {
-            drawPixel(x0, y);
-        }
-    } else if (deltaY == 0) {
-        int step = (x1 > x0) ? 1 : -1;
-        for (int x = x0; x != x1 + step; x += step) {
-            drawPixel(x, y0);
-        }
-    } else {
-        float slope = (float)deltaY / deltaX;
-        if (fabs(slope) <= 1) {
-            int step = (x1 > x0) ? 1 : -1;
-            for (int x = x0; x != x1 + step; x += step) {
-                drawPixel(x, roundToInt(slope * (x - x0) + y0));
-            }
-        } else {
-            int step = (y1 > y0) ? 1 : -1;
-            float inverseSlope = (float)deltaX / deltaY;
-            for (int y = y0; y != y1 + step; y += step) {
-                drawPixel(roundToInt(inverseSlope * (y - y0) + x0), y);
-            }
-        }
-    }
-
-    glEnd();
+    SumideroGL salida;
+    rasterizarLineaDirecta(salida, x0, y0, x1, y1, thickness);
 }
 
 // Redibuja todas las lneas almacenadas
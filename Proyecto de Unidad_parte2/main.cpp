@@ -1,4 +1,6 @@
 #include <GL/glut.h>
+#include "../Rasterizador/rasterizador.h"
+#include "../Rasterizador/sumidero_gl.h"
 #include <cmath>
 #include <vector>
 #include <iostream>
@@ -38,71 +40,16 @@ int selectedThickness = 1;
 bool firstClickPending = false;
 int firstClickX = 0, firstClickY = 0;
 
-inline int roundFloatToInt(float val) {
-    return static_cast<int>(floor(val + 0.5f));
-}
-
-// Dibuja un solo punto en (x,y)
-void drawPoint(int x, int y) {
-    glVertex2i(x, y);
-}
-
 // Algoritmo lnea directa
 void drawDirectLine(int x0, int y0, int x1, int y1, int thickness) {
-    int deltaX = x1 - x0;
-    int deltaY = y1 - y0;
-
-    glPointSize(thickness);
-    glBegin(GL_POINTS);
-
-    if (deltaX == 0) {
-        int step = (y1 > y0) ? 1 : -1;
-        for (int y = y0; y != y1 + step; y += step) {
-            drawPoint(x0, y);
-        }
-    } else if (deltaY == 0) {
-        int step = (x1 > x0) ? 1 : -1;
-        for (int x = x0; x != x1 + step; x += step) {
-            drawPoint(x, y0);
-        }
-    } else {
-        float slope = (float)deltaY / deltaX;
-        if (fabs(slope) <= 1) {
-            int step = (x1 > x0) ? 1 : -1;
-            for (int x = x0; x != x1 + step; x += step) {
-                drawPoint(x, roundFloatToInt(slope * (x - x0) + y0));
-            }
-        } else {
-            int step = (y1 > y0) ? 1 : -1;
-            float inverseSlope = (float)deltaX / deltaY;
-            for (int y = y0; y != y1 + step; y += step) {
-                drawPoint(roundFloatToInt(inverseSlope * (y - y0) + x0), y);
-            }
-        }
-    }
-
-    glEnd();
+    SumideroGL salida;
+    rasterizarLineaDirecta(salida, x0, y0, x1, y1, thickness);
 }
 
 // Algoritmo DDA para lnea
 void drawDDALine(int x0, int y0, int x1, int y1, int thickness) {
-    int diffX = x1 - x0;
-    int diffY = y1 - y0;
-
-    int steps = max(abs(diffX), abs(diffY));
-    float x = x0;
-    float y = y0;
-    float incX = diffX / (float)steps;
-    float incY = diffY / (float)steps;
-
-    glPointSize(thickness);
-    glBegin(GL_POINTS);
-    for (int i = 0; i <= steps; ++i) {
-        drawPoint(roundFloatToInt(x), roundFloatToInt(y));
-        x += incX;
-        y += incY;
-    }
-    glEnd();
+    SumideroGL salida;
+    rasterizarLineaDDA(salida, x0, y0, x1, y1, thickness);
 }
 
 // Funcin para dibujar una lnea segn su tipo
@@ -1,4 +1,6 @@
 #include <GL/glut.h>
+#include "../Rasterizador/rasterizador.h"
+#include "../Rasterizador/sumidero_gl.h"
 #include <cmath>
 #include <vector>
 #include <iostream>
@@ -46,155 +48,28 @@ bool isWaitingSecondClick = false;
 int firstClickX = 0;
 int firstClickY = 0;
 
-inline int roundToInt(float v) {
-    return static_cast<int>(floor(v + 0.5f));
-}
-
-// Pinta un punto en (x,y)
-void drawPoint(int x, int y) {
-    glVertex2i(x, y);
-}
-
 // Algoritmo lnea directa
 void drawLineDirect(int x0, int y0, int x1, int y1, int thickness) {
-    int dx = x1 - x0;
-    int dy = y1 - y0;
-
-    glPointSize(thickness);
-    glBegin(GL_POINTS);
-
-    if (dx == 0) {
-        int stepY = (y1 > y0) ? 1 : -1;
-        for (int y = y0; y != y1 + stepY; y += stepY) {
-            drawPoint(x0, y);
-        }
-    } else if (dy == 0) {
-        int stepX = (x1 > x0) ? 1 : -1;
-        for (int x = x0; x != x1 + stepX; x += stepX) {
-            drawPoint(x, y0);
-        }
-    } else {
-        float m = (float) dy / dx;
-        if (fabs(m) <= 1) {
-            int stepX = (x1 > x0) ? 1 : -1;
-            for (int x = x0; x != x1 + stepX; x += stepX) {
-                drawPoint(x, roundToInt(m * (x - x0) + y0));
-            }
-        } else {
-            int stepY = (y1 > y0) ? 1 : -1;
-            float invM = (float) dx / dy;
-            for (int y = y0; y != y1 + stepY; y += stepY) {
-                drawPoint(roundToInt(invM * (y - y0) + x0), y);
-            }
-        }
-    }
-    glEnd();
+    SumideroGL salida;
+    rasterizarLineaDirecta(salida, x0, y0, x1, y1, thickness);
 }
 
 // Algoritmo lnea DDA
 void drawLineDDA(int x0, int y0, int x1, int y1, int thickness) {
-    int dx = x1 - x0;
-    int dy = y1 - y0;
-    int steps = max(abs(dx), abs(dy));
-    float x = x0;
-    float y = y0;
-    float incX = dx / (float) steps;
-    float incY = dy / (float) steps;
-
-    glPointSize(thickness);
-    glBegin(GL_POINTS);
-    for (int i = 0; i <= steps; i++) {
-        drawPoint(roundToInt(x), roundToInt(y));
-        x += incX;
-        y += incY;
-    }
-    glEnd();
-}
-
-// Dibuja los 8 puntos simtricos de un crculo
-void drawCircle8Points(int cx, int cy, int x, int y) {
-    drawPoint(cx + x, cy + y);
-    drawPoint(cx - x, cy + y);
-    drawPoint(cx + x, cy - y);
-    drawPoint(cx - x, cy - y);
-    drawPoint(cx + y, cy + x);
-    drawPoint(cx - y, cy + x);
-    drawPoint(cx + y, cy - x);
-    drawPoint(cx - y, cy - x);
+    SumideroGL salida;
+    rasterizarLineaDDA(salida, x0, y0, x1, y1, thickness);
 }
 
 // Algoritmo crculo Punto Medio
 void drawCircleMidpoint(int cx, int cy, int radius, int thickness) {
-    int x = 0;
-    int y = radius;
-    int p = 1 - radius;
-
-    glPointSize(thickness);
-    glBegin(GL_POINTS);
-    drawCircle8Points(cx, cy, x, y);
-    while (x < y) {
-        x++;
-        if (p < 0) {
-            p += 2 * x + 1;
-        } else {
-            y--;
-            p += 2 * (x - y) + 1;
-        }
-        drawCircle8Points(cx, cy, x, y);
-    }
-    glEnd();
-}
-
-// Dibuja los 4 puntos simtricos de una elipse
-void drawEllipse4Points(int cx, int cy, int x, int y) {
-    drawPoint(cx + x, cy + y);
-    drawPoint(cx - x, cy + y);
-    drawPoint(cx + x, cy - y);
-    drawPoint(cx - x, cy - y);
+    SumideroGL salida;
+    rasterizarCirculo(salida, cx, cy, radius, thickness);
 }
 
 // Algoritmo elipse Punto Medio
 void drawEllipseMidpoint(int cx, int cy, int rx, int ry, int thickness) {
-    int x = 0;
-    int y = ry;
-    long rx2 = rx * rx;
-    long ry2 = ry * ry;
-    long two_rx2 = 2 * rx2;
-    long two_ry2 = 2 * ry2;
-    double p1 = ry2 - rx2 * ry + 0.25 * rx2;
-
-    glPointSize(thickness);
-    glBegin(GL_POINTS);
-
-    // Regin 1
-    while ((two_ry2 * x) <= (two_rx2 * y)) {
-        drawEllipse4Points(cx, cy, x, y);
-        if (p1 < 0) {
-            x++;
-            p1 += two_ry2 * x + ry2;
-        } else {
-            x++;
-            y--;
-            p1 += two_ry2 * x - two_rx2 * y + ry2;
-        }
-    }
-
-    double p2 = ry2*(x + 0.5)*(x + 0.5) + rx2*(y - 1)*(y - 1) - rx2*ry2;
-
-    // Regin 2
-    while (y >= 0) {
-        drawEllipse4Points(cx, cy, x, y);
-        if (p2 > 0) {
-            y--;
-            p2 -= two_rx2 * y + rx2;
-        } else {
-            y--;
-            x++;
-            p2 += two_ry2 * x - two_rx2 * y + rx2;
-        }
-    }
-
-    glEnd();
+    SumideroGL salida;
+    rasterizarElipse(salida, cx, cy, rx, ry, thickness);
 }
 
 // Dibuja una figura segn el tipo seleccionado
@@ -1,10 +1,38 @@
+#ifdef SIN_VENTANA
+#include "gl_sin_ventana.h"
+#else
 #include <GL/glut.h>
+#endif
+#include "../Rasterizador/rasterizador.h"
+#include "../Rasterizador/sumidero_gl.h"
 #include <cmath>
 #include <vector>
-#include <stack>
+#include <deque>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <climits>
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <dirent.h>
+#endif
 using namespace std;
 
 const int ANCHO_VENTANA = 800;
@@ -13,8 +41,12 @@ const int ALTO_VENTANA = 600;
 enum Herramienta {
     HERRAMIENTA_LINEA_DIRECTA,
     HERRAMIENTA_LINEA_DDA,
+    HERRAMIENTA_LINEA_BRESENHAM,
+    HERRAMIENTA_LINEA_DDA_FIJO,
     HERRAMIENTA_CIRCULO_PUNTO_MEDIO,
     HERRAMIENTA_ELIPSE_PUNTO_MEDIO,
+    HERRAMIENTA_CIRCULO_RELLENO,
+    HERRAMIENTA_ELIPSE_RELLENA,
     HERRAMIENTA_NINGUNA
 };
 
@@ -23,6 +55,40 @@ struct ColorRGB {
     float r, g, b;
 };
 
+// Destino de los puntos generados por los algoritmos de rasterización
+enum DestinoPixeles {
+    DESTINO_OPENGL,
+    DESTINO_LIENZO,
+    DESTINO_VERTICES
+};
+
+// Framebuffer RGB en memoria; la fila 0 es la inferior, igual que en OpenGL
+struct Lienzo {
+    int ancho, alto;
+    vector<unsigned char> pixeles;
+};
+
+// Paso de coordenadas del mundo (las de las figuras) a píxeles: el punto
+// (x, y) cae en (round(x escala) - desplazamientoX, round(y escala) - desplazamientoY)
+struct TransformacionVista {
+    double escala;
+    int desplazamientoX, desplazamientoY;
+};
+
+// Puntos ya rasterizados de cada figura, listos para glDrawArrays.
+// Los vértices de la figura i van de inicioFigura[i] a inicioFigura[i + 1].
+// Están a `escala` sin desplazar, y solo se rasterizó lo que cae en `recorte`;
+// las figuras anteriores a `desde` quedaron vacías
+struct CacheVertices {
+    vector<GLint> vertices;     // x,y intercalados
+    vector<GLubyte> colores;    // r,g,b por vértice
+    vector<size_t> inicioFigura;
+    Rectangulo recorte;
+    double escala;
+    size_t desde;
+};
+
+// Figura tal como la construye raton; en memoria se guarda en EscenaCompacta
 struct Figura {
     Herramienta tipoHerramienta;
     // Líneas: puntos inicio-fin
@@ -35,281 +101,3020 @@ struct Figura {
     int grosor;
 };
 
-vector<Figura> figuras;
-stack<vector<Figura>> pilaDeshacer;
-stack<vector<Figura>> pilaRehacer;
+enum TipoFigura {
+    TIPO_LINEA,
+    TIPO_CIRCULO,
+    TIPO_ELIPSE
+};
+
+// Cada tipo de figura guarda sus campos en arreglos paralelos, con el color
+// empaquetado en RGBA8 (r en el byte bajo) y el grosor en 8 bits
+struct LoteLineas {
+    vector<int> x0, y0, x1, y1;
+    vector<unsigned int> color;
+    vector<unsigned char> grosor;
+    vector<unsigned char> herramienta;
+};
+
+struct LoteCirculos {
+    vector<int> cx, cy, r;
+    vector<unsigned int> color;
+    vector<unsigned char> grosor;
+    vector<unsigned char> relleno;      // 1 si se rellena el disco
+};
+
+struct LoteElipses {
+    vector<int> cx, cy, rx, ry;
+    vector<unsigned int> color;
+    vector<unsigned char> grosor;
+    vector<unsigned char> relleno;
+};
+
+// orden[i] lleva el tipo de la figura i en los 2 bits altos y su posición
+// dentro del lote en el resto; así se conserva el orden de dibujo
+struct EscenaCompacta {
+    vector<unsigned int> orden;
+    LoteLineas lineas;
+    LoteCirculos circulos;
+    LoteElipses elipses;
+};
+
+const int BITS_POSICION_LOTE = 30;
+
+const int TAM_CELDA_INDICE = 64;
+const int MAX_CELDAS_POR_FIGURA = 256;
+
+// Cuadrícula uniforme sobre las cajas de todas las figuras guardadas. Cada
+// celda lista sus figuras en orden creciente; las que tocarían demasiadas
+// celdas van a `grandes`. Deshacer y limpiar no la modifican: las consultas
+// se limitan a [inicioEscena, finEscena) con búsqueda binaria
+struct IndiceEspacial {
+    unordered_map<long long, vector<unsigned int>> celdas;
+    vector<unsigned int> grandes;
+};
+
+// Operación del historial: cada una solo mueve los límites de la escena
+enum TipoOperacion {
+    OPERACION_AGREGAR,
+    OPERACION_LIMPIAR,
+    OPERACION_LOTE
+};
+
+struct Operacion {
+    TipoOperacion tipo;
+    size_t inicioAntes, finAntes;
+    size_t inicioDespues, finDespues;
+};
+
+// figuras solo crece por el final. La escena visible es el rango
+// [inicioEscena, finEscena); lo que queda fuera solo existe para deshacer/rehacer
+EscenaCompacta figuras;
+EscenaCompacta escenaPrevia;        // solo la figura de la vista previa
+size_t inicioEscena = 0;
+size_t finEscena = 0;
+deque<Operacion> historial;
+size_t posicionHistorial = 0;   // historial[0, posicionHistorial) se puede deshacer
+size_t limiteMemoriaHistorial = 64u << 20;
+
+// Formatos de exportación; QOI y PNG se codifican aquí mismo, sin bibliotecas
+enum FormatoImagen {
+    FORMATO_PPM,
+    FORMATO_QOI,
+    FORMATO_PNG
+};
+
+// Exportación en segundo plano. En cola, cada trabajo guarda solo el rango
+// visible; si una operación va a borrar o renumerar figuras guardadas, pasa
+// antes a tener su propia copia del rango. Al empezar, el hilo copia el rango
+// con candadoEscena tomado y rasteriza la copia ya sin el candado
+struct TrabajoExportacion {
+    string ruta;
+    FormatoImagen formato;
+    bool copiaPropia;
+    EscenaCompacta copia;
+    size_t desde, hasta;
+    int ancho, alto;
+    TransformacionVista vista;      // zoom y desplazamiento de la ventana al pedirla
+    bool cuadricula, ejes;
+};
+
+mutex candadoEscena;                // lo toman las operaciones que modifican figuras y la copia del rango
+mutex candadoExportaciones;         // protege la cola y `exportando`
+condition_variable hayExportacion, exportacionTerminada;
+deque<TrabajoExportacion> colaExportaciones;
+thread hiloExportacion;
+bool exportando = false;            // el hilo tiene un trabajo empezado
+bool cerrandoExportaciones = false; // al salir: el hilo acaba cuando la cola queda vacía
+atomic<int> filasExportadas(0), filasPorExportar(0);
+bool progresoExportacionVisible = false;
+const size_t TAM_BUFER_EXPORTACION = 1 << 20;
+
+Herramienta herramientaActual = HERRAMIENTA_LINEA_DIRECTA;
+ColorRGB colorActual = {0.f, 0.f, 0.f};
+int grosorActual = 1;
+bool mostrarCuadricula = true;
+bool mostrarEjes = true;
+bool esperandoSegundoClick = false;
+int primerX = 0;
+int primerY = 0;
+int previaX = 0, previaY = 0;       // último punto del ratón, en píxeles con y hacia arriba
+int anchoViewport = ANCHO_VENTANA;
+int altoViewport = ALTO_VENTANA;
+
+// Zoom con la rueda (en pasos de FACTOR_ZOOM) y desplazamiento arrastrando
+// con el botón central
+const TransformacionVista VISTA_IDENTIDAD = {1, 0, 0};
+const double FACTOR_ZOOM = 1.25;
+const int NIVEL_ZOOM_MINIMO = -18;      // escala 1/55
+const int NIVEL_ZOOM_MAXIMO = 15;       // escala 28
+const int BOTON_RUEDA_ARRIBA = 3;       // GLUT informa la rueda como botones 3 y 4
+const int BOTON_RUEDA_ABAJO = 4;
+TransformacionVista transformacionVista = VISTA_IDENTIDAD;
+int nivelZoom = 0;
+bool arrastrandoVista = false;
+int arrastreX = 0, arrastreY = 0;
+
+// Estado del destino de píxeles, propio de cada hilo de rasterización
+thread_local DestinoPixeles destinoPixeles = DESTINO_OPENGL;
+thread_local Lienzo *lienzoDestino = NULL;
+CacheVertices cacheVertices;
+IndiceEspacial indiceEspacial;
+bool indiceInvalido = false;    // se reconstruye en la próxima consulta
+vector<unsigned int> figurasVisibles;
+
+// Cambio pendiente en el lienzo persistente: dibujar una figura encima o
+// repintar una zona desde el fondo. Se aplican en el orden en que ocurrieron
+struct CambioLienzo {
+    bool esZona;
+    unsigned int figura;
+    Rectangulo zona;        // caja en el mundo
+};
+
+const size_t MAX_CAMBIOS_LIENZO = 256;
+
+bool usarLienzoPersistente = false;
+Lienzo lienzoPersistente = {0, 0, vector<unsigned char>()};
+bool lienzoPersistenteInvalido = true;
+vector<CambioLienzo> cambiosLienzo;
+
+// Copia de la ventana sin la vista previa: mientras solo se mueve el ratón
+// cada cuadro la repone con glDrawPixels y dibuja encima una sola figura
+Lienzo capturaEscena = {0, 0, vector<unsigned char>()};
+bool capturaEscenaValida = false;
+Lienzo lienzoVistaPrevia = {0, 0, vector<unsigned char>()};
+thread_local Rectangulo recorteLienzo = {INT_MIN, INT_MIN, INT_MAX, INT_MAX};
+thread_local TransformacionVista transformacionDestino = VISTA_IDENTIDAD;
+thread_local unsigned long pixelesTocados = 0;   // píxeles escritos en el último frame
+
+// Instrumentación por cuadro. Con medirCuadros apagado solo cuesta una
+// comprobación por figura. Solo mide el hilo principal, que es el que cierra
+// los cuadros: en los hilos de teselas y de exportación medirCuadros sigue
+// apagado, así que no leen el interruptor mientras la interfaz lo cambia
+struct MedicionHerramienta {
+    unsigned long figuras;
+    unsigned long long puntos;
+    double ms;
+};
+
+struct EstadisticasCuadro {
+    unsigned long numero;
+    double msTotal, msFondo, msFiguras;
+    size_t figuras;                 // figuras enviadas a la pantalla
+    unsigned long long puntos;      // vértices enviados o píxeles tocados
+    MedicionHerramienta herramientas[HERRAMIENTA_NINGUNA];
+};
+
+const char *NOMBRES_HERRAMIENTAS[HERRAMIENTA_NINGUNA] = {
+    "directa", "dda", "bresenham", "dda_fijo", "circulo", "elipse", "circulo_relleno", "elipse_rellena"
+};
+
+// Acumulado de los cuadros medidos, para las reproducciones de sesiones
+struct ResumenCuadros {
+    unsigned long cuadros;
+    double msTotal, msMaximo;
+};
+
+thread_local bool medirCuadros = false;
+EstadisticasCuadro ultimoCuadro = {};
+ResumenCuadros resumenCuadros = {};
+thread_local MedicionHerramienta medicionHerramientas[HERRAMIENTA_NINGUNA];
+thread_local double msFondoMedido = 0;
+thread_local chrono::steady_clock::time_point inicioFiguraMedida;
+thread_local unsigned long long puntosAlEmpezarFigura = 0;
+
+// Capa de fondo (cuadrícula y ejes): lista de OpenGL y copia en memoria.
+// Solo se reconstruyen al cambiar el tamaño de la ventana o un interruptor
+GLuint listaFondo = 0;
+bool listaFondoInvalida = true;
+Lienzo fondoLienzo = {0, 0, vector<unsigned char>()};
+TransformacionVista transformacionFondo = VISTA_IDENTIDAD;
+bool fondoLienzoInvalido = true;
+thread_local const Lienzo *fondoHilo = NULL;    // fondo propio, para exportar sin tocar la caché
+
+// Convierte una componente [0,1] a byte como lo hace OpenGL
+inline unsigned char componenteAByte(float c) {
+    if (c <= 0.f) return 0;
+    if (c >= 1.f) return 255;
+    return (unsigned char) redondearAEntero(c * 255.f);
+}
+
+// Escena compacta
+inline TipoFigura tipoFigura(unsigned int ref) {
+    return (TipoFigura) (ref >> BITS_POSICION_LOTE);
+}
+
+inline size_t posicionEnLote(unsigned int ref) {
+    return ref & ((1u << BITS_POSICION_LOTE) - 1);
+}
+
+unsigned int empaquetarColor(const ColorRGB &c) {
+    return componenteAByte(c.r) | componenteAByte(c.g) << 8 | componenteAByte(c.b) << 16 | 0xFF000000u;
+}
+
+size_t cantidadFiguras(const EscenaCompacta &e) {
+    return e.orden.size();
+}
+
+void agregarAEscena(EscenaCompacta &e, const Figura &f) {
+    unsigned int color = empaquetarColor(f.color);
+    unsigned char grosor = (unsigned char) f.grosor;
+    if (f.tipoHerramienta == HERRAMIENTA_CIRCULO_PUNTO_MEDIO || f.tipoHerramienta == HERRAMIENTA_CIRCULO_RELLENO) {
+        LoteCirculos &c = e.circulos;
+        e.orden.push_back(TIPO_CIRCULO << BITS_POSICION_LOTE | (unsigned int) c.cx.size());
+        c.cx.push_back(f.centroX);
+        c.cy.push_back(f.centroY);
+        c.r.push_back(f.radio);
+        c.color.push_back(color);
+        c.grosor.push_back(grosor);
+        c.relleno.push_back(f.tipoHerramienta == HERRAMIENTA_CIRCULO_RELLENO);
+    } else if (f.tipoHerramienta == HERRAMIENTA_ELIPSE_PUNTO_MEDIO || f.tipoHerramienta == HERRAMIENTA_ELIPSE_RELLENA) {
+        LoteElipses &el = e.elipses;
+        e.orden.push_back(TIPO_ELIPSE << BITS_POSICION_LOTE | (unsigned int) el.cx.size());
+        el.cx.push_back(f.centroX);
+        el.cy.push_back(f.centroY);
+        el.rx.push_back(f.radioX);
+        el.ry.push_back(f.radioY);
+        el.color.push_back(color);
+        el.grosor.push_back(grosor);
+        el.relleno.push_back(f.tipoHerramienta == HERRAMIENTA_ELIPSE_RELLENA);
+    } else {
+        LoteLineas &l = e.lineas;
+        e.orden.push_back(TIPO_LINEA << BITS_POSICION_LOTE | (unsigned int) l.x0.size());
+        l.x0.push_back(f.xInicio);
+        l.y0.push_back(f.yInicio);
+        l.x1.push_back(f.xFin);
+        l.y1.push_back(f.yFin);
+        l.color.push_back(color);
+        l.grosor.push_back(grosor);
+        l.herramienta.push_back((unsigned char) f.tipoHerramienta);
+    }
+}
+
+unsigned char grosorFigura(const EscenaCompacta &e, size_t i) {
+    size_t k = posicionEnLote(e.orden[i]);
+    switch (tipoFigura(e.orden[i])) {
+        case TIPO_CIRCULO: return e.circulos.grosor[k];
+        case TIPO_ELIPSE: return e.elipses.grosor[k];
+        default: return e.lineas.grosor[k];
+    }
+}
+
+bool figuraRellena(const EscenaCompacta &e, size_t i) {
+    size_t k = posicionEnLote(e.orden[i]);
+    switch (tipoFigura(e.orden[i])) {
+        case TIPO_CIRCULO: return e.circulos.relleno[k] != 0;
+        case TIPO_ELIPSE: return e.elipses.relleno[k] != 0;
+        default: return false;
+    }
+}
+
+template <class T>
+void borrarPrincipio(vector<T> &v, size_t n) {
+    v.erase(v.begin(), v.begin() + n);
+}
+
+template <class T>
+void copiar(vector<T> &destino, const vector<T> &origen, size_t desde, size_t n) {
+    destino.assign(origen.begin() + desde, origen.begin() + desde + n);
+}
+
+void redimensionarLote(LoteLineas &l, size_t n) {
+    l.x0.resize(n); l.y0.resize(n); l.x1.resize(n); l.y1.resize(n);
+    l.color.resize(n); l.grosor.resize(n); l.herramienta.resize(n);
+}
+
+void redimensionarLote(LoteCirculos &c, size_t n) {
+    c.cx.resize(n); c.cy.resize(n); c.r.resize(n);
+    c.color.resize(n); c.grosor.resize(n); c.relleno.resize(n);
+}
+
+void redimensionarLote(LoteElipses &el, size_t n) {
+    el.cx.resize(n); el.cy.resize(n); el.rx.resize(n); el.ry.resize(n);
+    el.color.resize(n); el.grosor.resize(n); el.relleno.resize(n);
+}
+
+void borrarPrincipioLote(LoteLineas &l, size_t n) {
+    borrarPrincipio(l.x0, n); borrarPrincipio(l.y0, n); borrarPrincipio(l.x1, n); borrarPrincipio(l.y1, n);
+    borrarPrincipio(l.color, n); borrarPrincipio(l.grosor, n); borrarPrincipio(l.herramienta, n);
+}
+
+void borrarPrincipioLote(LoteCirculos &c, size_t n) {
+    borrarPrincipio(c.cx, n); borrarPrincipio(c.cy, n); borrarPrincipio(c.r, n);
+    borrarPrincipio(c.color, n); borrarPrincipio(c.grosor, n); borrarPrincipio(c.relleno, n);
+}
+
+void borrarPrincipioLote(LoteElipses &el, size_t n) {
+    borrarPrincipio(el.cx, n); borrarPrincipio(el.cy, n); borrarPrincipio(el.rx, n); borrarPrincipio(el.ry, n);
+    borrarPrincipio(el.color, n); borrarPrincipio(el.grosor, n); borrarPrincipio(el.relleno, n);
+}
+
+// Deja solo las primeras n figuras
+void truncarEscena(EscenaCompacta &e, size_t n) {
+    size_t quitar[3] = {0, 0, 0};
+    for (size_t i = n; i < e.orden.size(); i++) quitar[tipoFigura(e.orden[i])]++;
+    e.orden.resize(n);
+    redimensionarLote(e.lineas, e.lineas.x0.size() - quitar[TIPO_LINEA]);
+    redimensionarLote(e.circulos, e.circulos.cx.size() - quitar[TIPO_CIRCULO]);
+    redimensionarLote(e.elipses, e.elipses.cx.size() - quitar[TIPO_ELIPSE]);
+}
+
+// Elimina las primeras n figuras y renumera las posiciones de las demás
+void borrarPrincipioEscena(EscenaCompacta &e, size_t n) {
+    size_t quitar[3] = {0, 0, 0};
+    for (size_t i = 0; i < n; i++) quitar[tipoFigura(e.orden[i])]++;
+    borrarPrincipio(e.orden, n);
+    for (auto &ref : e.orden) ref -= (unsigned int) quitar[tipoFigura(ref)];
+    borrarPrincipioLote(e.lineas, quitar[TIPO_LINEA]);
+    borrarPrincipioLote(e.circulos, quitar[TIPO_CIRCULO]);
+    borrarPrincipioLote(e.elipses, quitar[TIPO_ELIPSE]);
+}
+
+// Copia en destino las figuras [desde, hasta) de origen, renumeradas desde 0.
+// Las de cada tipo están seguidas en su lote, así que basta un rango por lote
+void copiarRangoEscena(const EscenaCompacta &origen, size_t desde, size_t hasta, EscenaCompacta &destino) {
+    size_t primero[3] = {0, 0, 0}, cantidad[3] = {0, 0, 0};
+    for (size_t i = desde; i < hasta; i++) {
+        TipoFigura t = tipoFigura(origen.orden[i]);
+        if (cantidad[t]++ == 0) primero[t] = posicionEnLote(origen.orden[i]);
+    }
+    destino.orden.assign(origen.orden.begin() + desde, origen.orden.begin() + hasta);
+    for (auto &ref : destino.orden) ref -= (unsigned int) primero[tipoFigura(ref)];
+    const LoteLineas &l = origen.lineas;
+    size_t a = primero[TIPO_LINEA], n = cantidad[TIPO_LINEA];
+    copiar(destino.lineas.x0, l.x0, a, n); copiar(destino.lineas.y0, l.y0, a, n);
+    copiar(destino.lineas.x1, l.x1, a, n); copiar(destino.lineas.y1, l.y1, a, n);
+    copiar(destino.lineas.color, l.color, a, n); copiar(destino.lineas.grosor, l.grosor, a, n);
+    copiar(destino.lineas.herramienta, l.herramienta, a, n);
+    const LoteCirculos &c = origen.circulos;
+    a = primero[TIPO_CIRCULO], n = cantidad[TIPO_CIRCULO];
+    copiar(destino.circulos.cx, c.cx, a, n); copiar(destino.circulos.cy, c.cy, a, n);
+    copiar(destino.circulos.r, c.r, a, n); copiar(destino.circulos.color, c.color, a, n);
+    copiar(destino.circulos.grosor, c.grosor, a, n); copiar(destino.circulos.relleno, c.relleno, a, n);
+    const LoteElipses &el = origen.elipses;
+    a = primero[TIPO_ELIPSE], n = cantidad[TIPO_ELIPSE];
+    copiar(destino.elipses.cx, el.cx, a, n); copiar(destino.elipses.cy, el.cy, a, n);
+    copiar(destino.elipses.rx, el.rx, a, n); copiar(destino.elipses.ry, el.ry, a, n);
+    copiar(destino.elipses.color, el.color, a, n); copiar(destino.elipses.grosor, el.grosor, a, n);
+    copiar(destino.elipses.relleno, el.relleno, a, n);
+}
+
+template <class T>
+void anexar(vector<T> &destino, const vector<T> &origen) {
+    destino.insert(destino.end(), origen.begin(), origen.end());
+}
+
+// Agrega al final de destino todas las figuras de origen
+void anexarEscena(EscenaCompacta &destino, const EscenaCompacta &origen) {
+    size_t base[3] = {destino.lineas.x0.size(), destino.circulos.cx.size(), destino.elipses.cx.size()};
+    for (unsigned int ref : origen.orden) destino.orden.push_back(ref + (unsigned int) base[tipoFigura(ref)]);
+    const LoteLineas &l = origen.lineas;
+    anexar(destino.lineas.x0, l.x0); anexar(destino.lineas.y0, l.y0);
+    anexar(destino.lineas.x1, l.x1); anexar(destino.lineas.y1, l.y1);
+    anexar(destino.lineas.color, l.color); anexar(destino.lineas.grosor, l.grosor);
+    anexar(destino.lineas.herramienta, l.herramienta);
+    const LoteCirculos &c = origen.circulos;
+    anexar(destino.circulos.cx, c.cx); anexar(destino.circulos.cy, c.cy); anexar(destino.circulos.r, c.r);
+    anexar(destino.circulos.color, c.color); anexar(destino.circulos.grosor, c.grosor);
+    anexar(destino.circulos.relleno, c.relleno);
+    const LoteElipses &el = origen.elipses;
+    anexar(destino.elipses.cx, el.cx); anexar(destino.elipses.cy, el.cy);
+    anexar(destino.elipses.rx, el.rx); anexar(destino.elipses.ry, el.ry);
+    anexar(destino.elipses.color, el.color); anexar(destino.elipses.grosor, el.grosor);
+    anexar(destino.elipses.relleno, el.relleno);
+}
+
+size_t memoriaEscena(const EscenaCompacta &e) {
+    return e.orden.size() * sizeof(unsigned int)
+           + e.lineas.x0.size() * (4 * sizeof(int) + sizeof(unsigned int) + 2)
+           + e.circulos.cx.size() * (3 * sizeof(int) + sizeof(unsigned int) + 2)
+           + e.elipses.cx.size() * (4 * sizeof(int) + sizeof(unsigned int) + 2);
+}
+
+// Índice espacial
+// Caja de la figura i, ampliada por la mitad de su grosor
+Rectangulo cajaFigura(const EscenaCompacta &e, size_t i) {
+    size_t k = posicionEnLote(e.orden[i]);
+    Rectangulo r;
+    int margen;
+    switch (tipoFigura(e.orden[i])) {
+        case TIPO_CIRCULO: {
+            const LoteCirculos &c = e.circulos;
+            r.x0 = c.cx[k] - c.r[k]; r.x1 = c.cx[k] + c.r[k];
+            r.y0 = c.cy[k] - c.r[k]; r.y1 = c.cy[k] + c.r[k];
+            margen = c.grosor[k] / 2;
+            break;
+        }
+        case TIPO_ELIPSE: {
+            // Con un radio 0 el punto medio aún da un paso de 1 px en ese eje
+            const LoteElipses &el = e.elipses;
+            int rx = max(el.rx[k], 1), ry = max(el.ry[k], 1);
+            r.x0 = el.cx[k] - rx; r.x1 = el.cx[k] + rx;
+            r.y0 = el.cy[k] - ry; r.y1 = el.cy[k] + ry;
+            margen = el.grosor[k] / 2;
+            break;
+        }
+        default: {
+            const LoteLineas &l = e.lineas;
+            r.x0 = min(l.x0[k], l.x1[k]); r.x1 = max(l.x0[k], l.x1[k]);
+            r.y0 = min(l.y0[k], l.y1[k]); r.y1 = max(l.y0[k], l.y1[k]);
+            // Las esquinas del trazo ancho sobresalen hasta g/2 * raíz de 2
+            margen = l.grosor[k];
+            break;
+        }
+    }
+    r.x0 -= margen; r.y0 -= margen;
+    r.x1 += margen; r.y1 += margen;
+    return r;
+}
+
+inline bool seIntersecan(const Rectangulo &a, const Rectangulo &b) {
+    return a.x0 <= b.x1 && b.x0 <= a.x1 && a.y0 <= b.y1 && b.y0 <= a.y1;
+}
+
+// b cabe entero dentro de a
+inline bool contieneRectangulo(const Rectangulo &a, const Rectangulo &b) {
+    return a.x0 <= b.x0 && a.y0 <= b.y0 && b.x1 <= a.x1 && b.y1 <= a.y1;
+}
+
+// Transformación de la vista. Los resultados se acotan a ±1e9, así la
+// diferencia de dos coordenadas, el doble de un radio y los grosores escalados
+// caben en int. Los algoritmos aceptan ese rango siempre que el sumidero
+// tenga recorte: las elipses demasiado grandes para el punto medio se dibujan
+// por filas, y por eso la ventana también recorta (ver dibujarFiguras)
+inline int acotarCoordenada(double v) {
+    return (int) llround(max(-1e9, min(1e9, v)));
+}
+
+inline int pantallaX(const TransformacionVista &t, int x) {
+    return acotarCoordenada(x * t.escala - t.desplazamientoX);
+}
+
+inline int pantallaY(const TransformacionVista &t, int y) {
+    return acotarCoordenada(y * t.escala - t.desplazamientoY);
+}
+
+inline int longitudEnPantalla(const TransformacionVista &t, int d) {
+    return acotarCoordenada(d * t.escala);
+}
+
+// El grosor escala con la figura, sin bajar de 1 px
+inline int grosorEnPantalla(const TransformacionVista &t, int g) {
+    return max(1, acotarCoordenada(g * t.escala));
+}
+
+inline int mundoX(const TransformacionVista &t, int x) {
+    return acotarCoordenada((x + t.desplazamientoX) / t.escala);
+}
+
+inline int mundoY(const TransformacionVista &t, int y) {
+    return acotarCoordenada((y + t.desplazamientoY) / t.escala);
+}
+
+inline bool mismaTransformacion(const TransformacionVista &a, const TransformacionVista &b) {
+    return a.escala == b.escala && a.desplazamientoX == b.desplazamientoX && a.desplazamientoY == b.desplazamientoY;
+}
+
+// Caja en píxeles de una caja del mundo. Con escala distinta de 1 el radio
+// y el grosor se redondean aparte del centro, de ahí el píxel de holgura, y
+// la media unidad que cajaFigura quita al partir el grosor crece con el zoom
+Rectangulo rectanguloEnPantalla(const TransformacionVista &t, const Rectangulo &r) {
+    int h = t.escala == 1 ? 0 : 1 + (int) ceil(t.escala / 2);
+    Rectangulo p = {pantallaX(t, r.x0) - h, pantallaY(t, r.y0) - h, pantallaX(t, r.x1) + h, pantallaY(t, r.y1) + h};
+    return p;
+}
+
+// Píxeles en [0, largo] donde caen las líneas de la cuadrícula: una cada 20
+// unidades del mundo, o cada 100, 500... si así quedarían a menos de 8 px
+void posicionesCuadricula(double escala, int desplazamiento, int largo, vector<int> &posiciones) {
+    posiciones.clear();
+    double paso = 20;
+    while (paso * escala < 8) paso *= 5;
+    for (long long k = (long long) floor(desplazamiento / (paso * escala)) - 1;; k++) {
+        long long p = llround(k * paso * escala) - desplazamiento;
+        if (p > largo) break;
+        if (p >= 0) posiciones.push_back((int) p);
+    }
+}
+
+// Caja del mundo que cubre una caja en píxeles, con al menos la misma holgura
+Rectangulo rectanguloEnMundo(const TransformacionVista &t, const Rectangulo &r) {
+    if (t.escala == 1) {
+        Rectangulo m = {r.x0 + t.desplazamientoX, r.y0 + t.desplazamientoY, r.x1 + t.desplazamientoX,
+                        r.y1 + t.desplazamientoY};
+        return m;
+    }
+    double h = 2 / t.escala + 1;
+    Rectangulo m = {acotarCoordenada(floor((r.x0 + t.desplazamientoX) / t.escala - h)),
+                    acotarCoordenada(floor((r.y0 + t.desplazamientoY) / t.escala - h)),
+                    acotarCoordenada(ceil((r.x1 + t.desplazamientoX) / t.escala + h)),
+                    acotarCoordenada(ceil((r.y1 + t.desplazamientoY) / t.escala + h))};
+    return m;
+}
+
+// División entera redondeando hacia abajo también para negativos
+inline int celdaDe(int v) {
+    return v >= 0 ? v / TAM_CELDA_INDICE : -((-(v + 1)) / TAM_CELDA_INDICE) - 1;
+}
+
+inline long long claveCelda(int cx, int cy) {
+    return (long long) ((unsigned long long) (unsigned int) cx << 32 | (unsigned int) cy);
+}
+
+bool esFiguraGrande(const Rectangulo &r) {
+    long long celdas = (long long) (celdaDe(r.x1) - celdaDe(r.x0) + 1) * (celdaDe(r.y1) - celdaDe(r.y0) + 1);
+    return celdas > MAX_CELDAS_POR_FIGURA;
+}
+
+void indexarFigura(size_t i) {
+    if (indiceInvalido) return;
+    Rectangulo r = cajaFigura(figuras, i);
+    if (esFiguraGrande(r)) {
+        indiceEspacial.grandes.push_back((unsigned int) i);
+        return;
+    }
+    for (int cy = celdaDe(r.y0); cy <= celdaDe(r.y1); cy++)
+        for (int cx = celdaDe(r.x0); cx <= celdaDe(r.x1); cx++)
+            indiceEspacial.celdas[claveCelda(cx, cy)].push_back((unsigned int) i);
+}
+
+// Solo admite quitar la figura indexada más reciente, que está al final de sus celdas
+void desindexarFigura(size_t i) {
+    if (indiceInvalido) return;
+    Rectangulo r = cajaFigura(figuras, i);
+    if (esFiguraGrande(r)) {
+        indiceEspacial.grandes.pop_back();
+        return;
+    }
+    for (int cy = celdaDe(r.y0); cy <= celdaDe(r.y1); cy++) {
+        for (int cx = celdaDe(r.x0); cx <= celdaDe(r.x1); cx++) {
+            auto celda = indiceEspacial.celdas.find(claveCelda(cx, cy));
+            celda->second.pop_back();
+            if (celda->second.empty()) indiceEspacial.celdas.erase(celda);
+        }
+    }
+}
+
+void reconstruirIndice() {
+    indiceEspacial.celdas.clear();
+    indiceEspacial.grandes.clear();
+    indiceInvalido = false;
+    for (size_t i = 0; i < cantidadFiguras(figuras); i++) indexarFigura(i);
+}
+
+// Para cambios masivos: indexar figura a figura saldría más caro que
+// reconstruir una vez cuando haga falta
+void invalidarIndice() {
+    indiceEspacial.celdas.clear();
+    indiceEspacial.grandes.clear();
+    indiceInvalido = true;
+}
+
+void agregarVisiblesDeLista(const vector<unsigned int> &lista, const Rectangulo &r,
+                            vector<unsigned int> &resultado) {
+    auto a = lower_bound(lista.begin(), lista.end(), (unsigned int) inicioEscena);
+    auto b = lower_bound(a, lista.end(), (unsigned int) finEscena);
+    for (; a != b; ++a) {
+        if (seIntersecan(cajaFigura(figuras, *a), r)) resultado.push_back(*a);
+    }
+}
+
+// Consultas que tocan al menos esta cantidad de celdas juntan el resultado
+// en un mapa de bits en vez de ordenar, como al alejar el zoom
+const long long CELDAS_CONSULTA_CON_MARCAS = 64;
+
+struct ConsultaIndice {
+    const Rectangulo &r;
+    vector<unsigned int> &resultado;
+    vector<uint64_t> marcas;    // vacío si se ordena al final
+    vector<unsigned int> parcial;
+};
+
+// Agrega las figuras de una celda; si cae entera dentro de r todas sus
+// figuras tocan r y no hace falta mirar cajas
+void visitarCelda(ConsultaIndice &q, int cx, int cy, const vector<unsigned int> &lista) {
+    long long x0 = (long long) cx * TAM_CELDA_INDICE, y0 = (long long) cy * TAM_CELDA_INDICE;
+    bool entera = x0 >= q.r.x0 && y0 >= q.r.y0 && x0 + TAM_CELDA_INDICE - 1 <= q.r.x1 &&
+                  y0 + TAM_CELDA_INDICE - 1 <= q.r.y1;
+    if (q.marcas.empty()) {
+        if (!entera) {
+            agregarVisiblesDeLista(lista, q.r, q.resultado);
+            return;
+        }
+        auto a = lower_bound(lista.begin(), lista.end(), (unsigned int) inicioEscena);
+        auto b = lower_bound(a, lista.end(), (unsigned int) finEscena);
+        q.resultado.insert(q.resultado.end(), a, b);
+        return;
+    }
+    const vector<unsigned int> *visibles = &lista;
+    if (!entera) {
+        q.parcial.clear();
+        agregarVisiblesDeLista(lista, q.r, q.parcial);
+        visibles = &q.parcial;
+    }
+    auto a = lower_bound(visibles->begin(), visibles->end(), (unsigned int) inicioEscena);
+    auto b = lower_bound(a, visibles->end(), (unsigned int) finEscena);
+    for (; a != b; ++a) q.marcas[(*a - inicioEscena) / 64] |= 1ULL << ((*a - inicioEscena) % 64);
+}
+
+// Figuras de la escena cuya caja toca r, en orden de dibujo
+void consultarRectangulo(const Rectangulo &r, vector<unsigned int> &resultado) {
+    if (indiceInvalido) reconstruirIndice();
+    resultado.clear();
+    const IndiceEspacial &ind = indiceEspacial;
+    agregarVisiblesDeLista(ind.grandes, r, resultado);
+    long long celdasConsulta = (long long) (celdaDe(r.x1) - celdaDe(r.x0) + 1) * (celdaDe(r.y1) - celdaDe(r.y0) + 1);
+    ConsultaIndice q = {r, resultado, vector<uint64_t>(), vector<unsigned int>()};
+    if (celdasConsulta >= CELDAS_CONSULTA_CON_MARCAS) {
+        q.marcas.assign((finEscena - inicioEscena + 63) / 64, 0);
+        for (unsigned int i : resultado) q.marcas[(i - inicioEscena) / 64] |= 1ULL << ((i - inicioEscena) % 64);
+    }
+    if (celdasConsulta > (long long) ind.celdas.size()) {
+        for (auto &celda : ind.celdas) {
+            int cx = (int) (celda.first >> 32), cy = (int) (unsigned int) celda.first;
+            if (cx >= celdaDe(r.x0) && cx <= celdaDe(r.x1) && cy >= celdaDe(r.y0) && cy <= celdaDe(r.y1))
+                visitarCelda(q, cx, cy, celda.second);
+        }
+    } else {
+        for (int cy = celdaDe(r.y0); cy <= celdaDe(r.y1); cy++) {
+            for (int cx = celdaDe(r.x0); cx <= celdaDe(r.x1); cx++) {
+                auto celda = ind.celdas.find(claveCelda(cx, cy));
+                if (celda != ind.celdas.end()) visitarCelda(q, cx, cy, celda->second);
+            }
+        }
+    }
+    if (!q.marcas.empty()) {
+        resultado.clear();
+        for (size_t w = 0; w < q.marcas.size(); w++)
+            for (uint64_t m = q.marcas[w]; m; m &= m - 1)
+                resultado.push_back((unsigned int) (inicioEscena + 64 * w + __builtin_ctzll(m)));
+        return;
+    }
+    sort(resultado.begin(), resultado.end());
+    resultado.erase(unique(resultado.begin(), resultado.end()), resultado.end());
+}
+
+double distanciaASegmento(double px, double py, double ax, double ay, double bx, double by) {
+    double dx = bx - ax, dy = by - ay;
+    double largo2 = dx * dx + dy * dy;
+    double t = largo2 > 0 ? ((px - ax) * dx + (py - ay) * dy) / largo2 : 0;
+    t = max(0.0, min(1.0, t));
+    return hypot(px - (ax + t * dx), py - (ay + t * dy));
+}
+
+// Distancia aproximada de (x, y) al trazo de la figura i
+double distanciaAFigura(const EscenaCompacta &e, size_t i, int x, int y) {
+    size_t k = posicionEnLote(e.orden[i]);
+    switch (tipoFigura(e.orden[i])) {
+        case TIPO_CIRCULO: {
+            const LoteCirculos &c = e.circulos;
+            double d = hypot(x - c.cx[k], y - c.cy[k]) - c.r[k];
+            return c.relleno[k] ? max(d, 0.0) : fabs(d);
+        }
+        case TIPO_ELIPSE: {
+            const LoteElipses &el = e.elipses;
+            double dx = x - el.cx[k], dy = y - el.cy[k];
+            if (el.rx[k] == 0 || el.ry[k] == 0)
+                return distanciaASegmento(dx, dy, -el.rx[k], -el.ry[k], el.rx[k], el.ry[k]);
+            // Distancia radial al punto de la elipse en la misma dirección
+            double d = hypot(dx / el.rx[k], dy / el.ry[k]);
+            if (el.relleno[k] && d <= 1) return 0;
+            if (d == 0) return min(el.rx[k], el.ry[k]);
+            return fabs(hypot(dx, dy) * (1 - 1 / d));
+        }
+        default: {
+            const LoteLineas &l = e.lineas;
+            return distanciaASegmento(x, y, l.x0[k], l.y0[k], l.x1[k], l.y1[k]);
+        }
+    }
+}
+
+// Figura visible más reciente cuyo trazo pasa a `tolerancia` px o menos de
+// (x, y), pensada para seleccionar con un clic; -1 si no hay ninguna
+long figuraEnPunto(int x, int y, int tolerancia) {
+    Rectangulo r = {x - tolerancia, y - tolerancia, x + tolerancia, y + tolerancia};
+    vector<unsigned int> candidatas;
+    consultarRectangulo(r, candidatas);
+    for (size_t j = candidatas.size(); j-- > 0;) {
+        unsigned int i = candidatas[j];
+        if (distanciaAFigura(figuras, i, x, y) <= tolerancia + grosorFigura(figuras, i) / 2)
+            return i;
+    }
+    return -1;
+}
+
+// Daños del lienzo persistente; solo se registran si está activo
+void invalidarLienzoPersistente() {
+    lienzoPersistenteInvalido = true;
+    cambiosLienzo.clear();
+}
+
+void registrarCambioLienzo(bool esZona, size_t figura) {
+    if (!usarLienzoPersistente || lienzoPersistenteInvalido) return;
+    if (cambiosLienzo.size() >= MAX_CAMBIOS_LIENZO) {
+        invalidarLienzoPersistente();
+        return;
+    }
+    CambioLienzo c = {esZona, (unsigned int) figura, cajaFigura(figuras, figura)};
+    cambiosLienzo.push_back(c);
+}
+
+// Se llama cuando los índices de figuras dejan de corresponder con la caché
+void invalidarCacheVertices() {
+    cacheVertices.vertices.clear();
+    cacheVertices.colores.clear();
+    cacheVertices.inicioFigura.clear();
+}
+
+// Descarta de la caché las figuras con índice >= n
+void truncarCacheVertices(size_t n) {
+    CacheVertices &c = cacheVertices;
+    if (c.inicioFigura.size() <= n + 1) return;
+    c.vertices.resize(2 * c.inicioFigura[n]);
+    c.colores.resize(3 * c.inicioFigura[n]);
+    c.inicioFigura.resize(n + 1);
+}
+
+// Gestión Deshacer/Rehacer
+// Memoria que ocuparía el historial si se liberasen las primeras `liberables` figuras
+size_t memoriaHistorial(size_t liberables) {
+    size_t total = cantidadFiguras(figuras);
+    size_t ocultas = total - liberables - (finEscena - inicioEscena);
+    return historial.size() * sizeof(Operacion)
+           + (total ? memoriaEscena(figuras) / total * ocultas : 0);
+}
+
+// Antes de borrar o renumerar figuras guardadas (con candadoEscena tomado),
+// los trabajos en cola que las leen de `figuras` reciben su copia del rango
+void protegerExportaciones() {
+    lock_guard<mutex> bloqueo(candadoExportaciones);
+    for (auto &t : colaExportaciones) {
+        if (t.copiaPropia) continue;
+        copiarRangoEscena(figuras, t.desde, t.hasta, t.copia);
+        t.hasta -= t.desde;
+        t.desde = 0;
+        t.copiaPropia = true;
+    }
+}
+
+// Olvida las operaciones más antiguas hasta respetar limiteMemoriaHistorial y
+// libera las figuras que ya no puede recuperar ninguna operación
+void aplicarLimiteHistorial() {
+    size_t liberables = 0;
+    while (posicionHistorial > 0 && memoriaHistorial(liberables) > limiteMemoriaHistorial) {
+        historial.pop_front();
+        posicionHistorial--;
+        liberables = historial.empty() ? inicioEscena : historial.front().inicioAntes;
+    }
+    if (liberables == 0) return;
+    protegerExportaciones();
+    borrarPrincipioEscena(figuras, liberables);
+    for (auto &op : historial) {
+        op.inicioAntes -= liberables;
+        op.finAntes -= liberables;
+        op.inicioDespues -= liberables;
+        op.finDespues -= liberables;
+    }
+    inicioEscena -= liberables;
+    finEscena -= liberables;
+    invalidarCacheVertices();
+    invalidarLienzoPersistente();
+    invalidarIndice();
+}
+
+// Una operación nueva descarta lo que se podía rehacer
+void prepararOperacion() {
+    historial.resize(posicionHistorial);
+    if (cantidadFiguras(figuras) > finEscena) {
+        protegerExportaciones();
+        for (size_t i = cantidadFiguras(figuras); i-- > finEscena;) desindexarFigura(i);
+        truncarEscena(figuras, finEscena);
+        truncarCacheVertices(finEscena);
+    }
+}
+
+void registrarOperacion(TipoOperacion tipo, size_t inicioAntes, size_t finAntes) {
+    Operacion op = {tipo, inicioAntes, finAntes, inicioEscena, finEscena};
+    historial.push_back(op);
+    posicionHistorial++;
+    aplicarLimiteHistorial();
+}
+
+void agregarFigura(const Figura &f) {
+    lock_guard<mutex> bloqueo(candadoEscena);
+    prepararOperacion();
+    size_t finAntes = finEscena;
+    agregarAEscena(figuras, f);
+    indexarFigura(finEscena);
+    finEscena = cantidadFiguras(figuras);
+    registrarCambioLienzo(false, finAntes);
+    registrarOperacion(OPERACION_AGREGAR, inicioEscena, finAntes);
+}
+
+// Agrega n figuras como una sola operación de deshacer
+void agregarLoteFiguras(const Figura *f, size_t n) {
+    lock_guard<mutex> bloqueo(candadoEscena);
+    prepararOperacion();
+    size_t finAntes = finEscena;
+    for (size_t i = 0; i < n; i++) {
+        agregarAEscena(figuras, f[i]);
+        indexarFigura(finEscena + i);
+        registrarCambioLienzo(false, finEscena + i);
+    }
+    finEscena = cantidadFiguras(figuras);
+    registrarOperacion(OPERACION_LOTE, inicioEscena, finAntes);
+}
+
+// Solo mueve el inicio de la escena; las figuras siguen guardadas para deshacer
+void limpiarEscena() {
+    lock_guard<mutex> bloqueo(candadoEscena);
+    prepararOperacion();
+    size_t inicioAntes = inicioEscena;
+    inicioEscena = finEscena;
+    invalidarLienzoPersistente();
+    registrarOperacion(OPERACION_LIMPIAR, inicioAntes, finEscena);
+}
+
+void deshacer() {
+    if (posicionHistorial > 0) {
+        const Operacion &op = historial[--posicionHistorial];
+        // Quitar una figura solo ensucia su caja
+        if (op.tipo == OPERACION_AGREGAR) registrarCambioLienzo(true, op.finAntes);
+        else invalidarLienzoPersistente();
+        inicioEscena = op.inicioAntes;
+        finEscena = op.finAntes;
+        glutPostRedisplay();
+    }
+}
+
+void rehacer() {
+    if (posicionHistorial < historial.size()) {
+        const Operacion &op = historial[posicionHistorial++];
+        if (op.tipo == OPERACION_AGREGAR) registrarCambioLienzo(false, op.finAntes);
+        else invalidarLienzoPersistente();
+        inicioEscena = op.inicioDespues;
+        finEscena = op.finDespues;
+        glutPostRedisplay();
+    }
+}
+
+void pintarPixelLienzo(Lienzo &lienzo, int x, int y, const unsigned char color[3]) {
+    if (x < 0 || y < 0 || x >= lienzo.ancho || y >= lienzo.alto) return;
+    unsigned char *p = &lienzo.pixeles[3 * ((size_t) y * lienzo.ancho + x)];
+    p[0] = color[0];
+    p[1] = color[1];
+    p[2] = color[2];
+}
+
+// Trazos con grosor > 1: se rellenan por filas (rasterizarTrazoLinea y
+// rasterizarTrazoElipse) en vez de sellar un cuadrado en cada punto
+bool trazosPorTramos = true;
+
+template <class S>
+inline void fijarColor(S &s, unsigned int rgba) {
+    unsigned char rgb[3] = {(unsigned char) (rgba & 0xFF), (unsigned char) ((rgba >> 8) & 0xFF),
+                            (unsigned char) ((rgba >> 16) & 0xFF)};
+    s.fijarColor(rgb);
+}
+
+template <class S>
+inline void empezarFiguraMedida(const S &s) {
+    if (!medirCuadros) return;
+    puntosAlEmpezarFigura = s.emitidos();
+    inicioFiguraMedida = chrono::steady_clock::now();
+}
+
+template <class S>
+inline void terminarFiguraMedida(const S &s, Herramienta h) {
+    if (!medirCuadros) return;
+    MedicionHerramienta &m = medicionHerramientas[h];
+    m.ms += chrono::duration<double, milli>(chrono::steady_clock::now() - inicioFiguraMedida).count();
+    m.puntos += s.emitidos() - puntosAlEmpezarFigura;
+    m.figuras++;
+}
+
+// Marca en la caché de vértices dónde acaba la figura recién rasterizada
+void terminarFigura() {
+    if (destinoPixeles == DESTINO_VERTICES)
+        cacheVertices.inicioFigura.push_back(cacheVertices.vertices.size() / 2);
+}
+
+// Nivel de detalle: contornos de círculos y elipses con semiejes de hasta
+// RADIO_MAXIMO_CONTORNO px ya rasterizados alrededor de (0, 0). Al alejar el
+// zoom casi todas las figuras caen aquí y solo hay que desplazarlos
+const int RADIO_MAXIMO_CONTORNO = 16;
+
+struct ContornosPequenos {
+    vector<int> circulos[RADIO_MAXIMO_CONTORNO + 1];
+    vector<int> elipses[RADIO_MAXIMO_CONTORNO + 1][RADIO_MAXIMO_CONTORNO + 1];
+};
+
+ContornosPequenos construirContornosPequenos() {
+    ContornosPequenos c;
+    vector<unsigned char> colores;
+    for (int a = 0; a <= RADIO_MAXIMO_CONTORNO; a++) {
+        SumideroVertices sc(c.circulos[a], colores);
+        rasterizarCirculo(sc, 0, 0, a, 1);
+        for (int b = 0; b <= RADIO_MAXIMO_CONTORNO; b++) {
+            SumideroVertices se(c.elipses[a][b], colores);
+            rasterizarElipse(se, 0, 0, a, b, 1);
+        }
+    }
+    return c;
+}
+
+// Se construyen la primera vez que se piden, aunque sea desde un hilo de teselas
+const ContornosPequenos &contornosPequenos() {
+    static const ContornosPequenos c = construirContornosPequenos();
+    return c;
+}
+
+template <class S>
+void dibujarContorno(S &s, const vector<int> &contorno, int cx, int cy, int grosor) {
+    int xy[2 * PUNTOS_POR_BLOQUE_DDA];
+    int n = 0;
+    for (size_t i = 0; i < contorno.size(); i += 2) {
+        xy[2 * n] = cx + contorno[i];
+        xy[2 * n + 1] = cy + contorno[i + 1];
+        if (++n == PUNTOS_POR_BLOQUE_DDA) {
+            s.coordenadas(xy, n, grosor);
+            n = 0;
+        }
+    }
+    if (n > 0) s.coordenadas(xy, n, grosor);
+}
+
+// Contorno de menos de un píxel. Las figuras rellenas no pasan por aquí: en
+// la caché de vértices van como quads y una de un píxel ya es un solo tramo
+template <class S>
+inline void dibujarPuntoUnico(S &s, int x, int y) {
+    s.empezarPuntos(1);
+    s.punto(x, y);
+    s.terminarPuntos();
+}
+
+// Cada lote se recorre de forma contigua, figura a figura, pasando cada
+// figura a píxeles con transformacionDestino
+template <class S>
+void dibujarLoteLineas(S &s, const LoteLineas &l, size_t desde, size_t hasta) {
+    const TransformacionVista &t = transformacionDestino;
+    for (size_t k = desde; k < hasta; k++) {
+        empezarFiguraMedida(s);
+        fijarColor(s, l.color[k]);
+        // Una línea de menos de un píxel ya sale como un solo punto
+        int x0 = pantallaX(t, l.x0[k]), y0 = pantallaY(t, l.y0[k]);
+        int x1 = pantallaX(t, l.x1[k]), y1 = pantallaY(t, l.y1[k]);
+        int grosor = grosorEnPantalla(t, l.grosor[k]);
+        if (grosor > 1 && trazosPorTramos) {
+            rasterizarTrazoLinea(s, x0, y0, x1, y1, grosor);
+            terminarFigura();
+            terminarFiguraMedida(s, (Herramienta) l.herramienta[k]);
+            continue;
+        }
+        switch (l.herramienta[k]) {
+            case HERRAMIENTA_LINEA_DDA:
+                rasterizarLineaDDA(s, x0, y0, x1, y1, grosor);
+                break;
+            case HERRAMIENTA_LINEA_BRESENHAM:
+                rasterizarLineaBresenham(s, x0, y0, x1, y1, grosor);
+                break;
+            case HERRAMIENTA_LINEA_DDA_FIJO:
+                rasterizarLineaDDAFijo(s, x0, y0, x1, y1, grosor);
+                break;
+            default:
+                rasterizarLineaDirecta(s, x0, y0, x1, y1, grosor);
+                break;
+        }
+        terminarFigura();
+        terminarFiguraMedida(s, (Herramienta) l.herramienta[k]);
+    }
+}
+
+template <class S>
+void dibujarLoteCirculos(S &s, const LoteCirculos &c, size_t desde, size_t hasta) {
+    const TransformacionVista &t = transformacionDestino;
+    for (size_t k = desde; k < hasta; k++) {
+        empezarFiguraMedida(s);
+        fijarColor(s, c.color[k]);
+        int cx = pantallaX(t, c.cx[k]), cy = pantallaY(t, c.cy[k]), r = longitudEnPantalla(t, c.r[k]);
+        int grosor = grosorEnPantalla(t, c.grosor[k]);
+        bool trazoAncho = grosor > 1 && trazosPorTramos;
+        if (c.relleno[k]) rasterizarCirculoRelleno(s, cx, cy, r);
+        else if (r == 0 && grosor == 1) dibujarPuntoUnico(s, cx, cy);
+        else if (trazoAncho) rasterizarTrazoElipse(s, cx, cy, r, r, grosor);
+        else if (r <= RADIO_MAXIMO_CONTORNO) dibujarContorno(s, contornosPequenos().circulos[r], cx, cy, grosor);
+        else rasterizarCirculo(s, cx, cy, r, grosor);
+        terminarFigura();
+        terminarFiguraMedida(s, c.relleno[k] ? HERRAMIENTA_CIRCULO_RELLENO : HERRAMIENTA_CIRCULO_PUNTO_MEDIO);
+    }
+}
+
+template <class S>
+void dibujarLoteElipses(S &s, const LoteElipses &el, size_t desde, size_t hasta) {
+    const TransformacionVista &t = transformacionDestino;
+    for (size_t k = desde; k < hasta; k++) {
+        empezarFiguraMedida(s);
+        fijarColor(s, el.color[k]);
+        int cx = pantallaX(t, el.cx[k]), cy = pantallaY(t, el.cy[k]);
+        int rx = longitudEnPantalla(t, el.rx[k]), ry = longitudEnPantalla(t, el.ry[k]);
+        int grosor = grosorEnPantalla(t, el.grosor[k]);
+        bool trazoAncho = grosor > 1 && trazosPorTramos;
+        if (el.relleno[k]) rasterizarElipseRellena(s, cx, cy, rx, ry);
+        else if (rx == 0 && ry == 0 && grosor == 1) dibujarPuntoUnico(s, cx, cy);
+        else if (trazoAncho) rasterizarTrazoElipse(s, cx, cy, rx, ry, grosor);
+        else if (rx <= RADIO_MAXIMO_CONTORNO && ry <= RADIO_MAXIMO_CONTORNO)
+            dibujarContorno(s, contornosPequenos().elipses[rx][ry], cx, cy, grosor);
+        else rasterizarElipse(s, cx, cy, rx, ry, grosor);
+        terminarFigura();
+        terminarFiguraMedida(s, el.relleno[k] ? HERRAMIENTA_ELIPSE_RELLENA : HERRAMIENTA_ELIPSE_PUNTO_MEDIO);
+    }
+}
+
+// Dibuja las figuras [desde, hasta) en orden; cada tramo de figuras
+// consecutivas del mismo tipo ocupa posiciones contiguas de su lote
+template <class S>
+void dibujarFigurasEn(S &s, const EscenaCompacta &e, size_t desde, size_t hasta) {
+    size_t i = desde;
+    while (i < hasta) {
+        TipoFigura tipo = tipoFigura(e.orden[i]);
+        size_t j = i + 1;
+        while (j < hasta && tipoFigura(e.orden[j]) == tipo) j++;
+        size_t k = posicionEnLote(e.orden[i]);
+        switch (tipo) {
+            case TIPO_LINEA: dibujarLoteLineas(s, e.lineas, k, k + (j - i)); break;
+            case TIPO_CIRCULO: dibujarLoteCirculos(s, e.circulos, k, k + (j - i)); break;
+            case TIPO_ELIPSE: dibujarLoteElipses(s, e.elipses, k, k + (j - i)); break;
+        }
+        i = j;
+    }
+}
+
+// En la ventana solo se ve el viewport. Recortar ahí hace que los algoritmos
+// tomen sus caminos recortados; el margen cubre los puntos gruesos, que se
+// recortan por su centro
+const int MARGEN_RECORTE_VENTANA = 8192;
+
+// El destino se elige una vez por llamada; dentro de los algoritmos cada
+// punto va directo a su sumidero
+void dibujarFiguras(const EscenaCompacta &e, size_t desde, size_t hasta) {
+    if (destinoPixeles == DESTINO_LIENZO) {
+        Lienzo &l = *lienzoDestino;
+        SumideroMemoria s(l.pixeles.data(), l.ancho, l.alto, recorteLienzo);
+        dibujarFigurasEn(s, e, desde, hasta);
+        pixelesTocados += s.emitidos();
+    } else if (destinoPixeles == DESTINO_VERTICES) {
+        SumideroVertices s(cacheVertices.vertices, cacheVertices.colores, cacheVertices.recorte);
+        dibujarFigurasEn(s, e, desde, hasta);
+    } else {
+        SumideroGL gl;
+        Rectangulo z = {-MARGEN_RECORTE_VENTANA, -MARGEN_RECORTE_VENTANA,
+                        anchoViewport + MARGEN_RECORTE_VENTANA, altoViewport + MARGEN_RECORTE_VENTANA};
+        SumideroRecorte<SumideroGL> s(gl, z);
+        dibujarFigurasEn(s, e, desde, hasta);
+    }
+}
+
+// Deja vacías en la caché las figuras que faltan hasta la n
+void agregarFigurasVacias(CacheVertices &c, size_t n) {
+    while (c.inicioFigura.size() - 1 < n) c.inicioFigura.push_back(c.inicioFigura.back());
+}
+
+// Rasteriza solo las figuras que aún no están en la caché. `vista` va en
+// píxeles a la escala de la vista pero sin desplazar. La caché cubre la
+// vista con medio ancho y medio alto de margen por lado; si la vista se sale
+// de esa zona o cambia la escala se rehace, y entonces solo se rasterizan las
+// figuras que el índice encuentra en la zona nueva
+void actualizarCacheVertices(const Rectangulo &vista) {
+    CacheVertices &c = cacheVertices;
+    double escala = transformacionVista.escala;
+    if (!c.inicioFigura.empty() &&
+        (c.escala != escala || inicioEscena < c.desde || !contieneRectangulo(c.recorte, vista)))
+        invalidarCacheVertices();
+    DestinoPixeles destinoAnterior = destinoPixeles;
+    TransformacionVista transformacionAnterior = transformacionDestino;
+    destinoPixeles = DESTINO_VERTICES;
+    transformacionDestino = VISTA_IDENTIDAD;
+    transformacionDestino.escala = escala;
+    if (c.inicioFigura.empty()) {
+        int mx = (vista.x1 - vista.x0 + 1) / 2, my = (vista.y1 - vista.y0 + 1) / 2;
+        c.recorte.x0 = vista.x0 - mx;
+        c.recorte.y0 = vista.y0 - my;
+        c.recorte.x1 = vista.x1 + mx;
+        c.recorte.y1 = vista.y1 + my;
+        c.escala = escala;
+        c.desde = inicioEscena;
+        c.inicioFigura.push_back(0);
+        vector<unsigned int> lista;
+        consultarRectangulo(rectanguloEnMundo(transformacionDestino, c.recorte), lista);
+        size_t i = 0;
+        while (i < lista.size()) {
+            size_t j = i + 1;
+            while (j < lista.size() && lista[j] == lista[j - 1] + 1) j++;
+            agregarFigurasVacias(c, lista[i]);
+            dibujarFiguras(figuras, lista[i], lista[j - 1] + 1);
+            i = j;
+        }
+        agregarFigurasVacias(c, finEscena);
+    }
+    // terminarFigura agrega el límite de cada figura a inicioFigura
+    dibujarFiguras(figuras, c.inicioFigura.size() - 1, finEscena);
+    transformacionDestino = transformacionAnterior;
+    destinoPixeles = destinoAnterior;
+}
+
+void invalidarFondo() {
+    listaFondoInvalida = true;
+    fondoLienzoInvalido = true;
+}
+
+// Capa de estadísticas en pantalla y registro de cuadros en CSV; cualquiera
+// de los dos, o una reproducción de sesión, enciende medirCuadros
+bool mostrarEstadisticas = false;
+bool reproduciendoSesion = false;   // una reproducción mide todos los cuadros
+FILE *registroCuadros = NULL;
+string rutaRegistroCuadros = "cuadros.csv";
+string filasPendientesRegistro;     // se escriben como mucho cada segundo
+const double MS_ENTRE_ESCRITURAS_REGISTRO = 1000;
+chrono::steady_clock::time_point inicioRegistro, ultimaEscrituraRegistro, inicioCuadro;
+
+inline double msDesde(chrono::steady_clock::time_point t) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - t).count();
+}
+
+void actualizarMedirCuadros() {
+    medirCuadros = mostrarEstadisticas || registroCuadros != NULL || reproduciendoSesion;
+}
+
+void escribirRegistroCuadros() {
+    if (registroCuadros == NULL) return;
+    fwrite(filasPendientesRegistro.data(), 1, filasPendientesRegistro.size(), registroCuadros);
+    fflush(registroCuadros);
+    filasPendientesRegistro.clear();
+    ultimaEscrituraRegistro = chrono::steady_clock::now();
+}
+
+void cerrarRegistroCuadros() {
+    if (registroCuadros == NULL) return;
+    escribirRegistroCuadros();
+    fclose(registroCuadros);
+    registroCuadros = NULL;
+    actualizarMedirCuadros();
+}
+
+bool abrirRegistroCuadros(const string &ruta) {
+    cerrarRegistroCuadros();
+    registroCuadros = fopen(ruta.c_str(), "w");
+    if (registroCuadros == NULL) return false;
+    fputs("cuadro,t_ms,modo,ms_total,ms_fondo,ms_figuras,figuras,puntos", registroCuadros);
+    for (int h = 0; h < HERRAMIENTA_NINGUNA; h++)
+        fprintf(registroCuadros, ",figuras_%s,puntos_%s,ms_%s", NOMBRES_HERRAMIENTAS[h],
+                NOMBRES_HERRAMIENTAS[h], NOMBRES_HERRAMIENTAS[h]);
+    fputs("\n", registroCuadros);
+    inicioRegistro = ultimaEscrituraRegistro = chrono::steady_clock::now();
+    actualizarMedirCuadros();
+    return true;
+}
+
+void agregarFilaRegistro(const EstadisticasCuadro &e) {
+    char fila[128];
+    snprintf(fila, sizeof(fila), "%lu,%.3f,%s,%.3f,%.3f,%.3f,%lu,%llu", e.numero, msDesde(inicioRegistro),
+             usarLienzoPersistente ? "lienzo" : "gl", e.msTotal, e.msFondo, e.msFiguras,
+             (unsigned long) e.figuras, e.puntos);
+    filasPendientesRegistro += fila;
+    for (int h = 0; h < HERRAMIENTA_NINGUNA; h++) {
+        const MedicionHerramienta &m = e.herramientas[h];
+        snprintf(fila, sizeof(fila), ",%lu,%llu,%.3f", m.figuras, m.puntos, m.ms);
+        filasPendientesRegistro += fila;
+    }
+    filasPendientesRegistro += '\n';
+    if (msDesde(ultimaEscrituraRegistro) >= MS_ENTRE_ESCRITURAS_REGISTRO) escribirRegistroCuadros();
+}
+
+void empezarCuadro() {
+    for (int h = 0; h < HERRAMIENTA_NINGUNA; h++) medicionHerramientas[h] = MedicionHerramienta();
+    msFondoMedido = 0;
+    inicioCuadro = chrono::steady_clock::now();
+}
+
+// Cierra la medición del cuadro y guarda la fila en el registro
+void terminarCuadro(size_t figurasEnviadas, unsigned long long puntos) {
+    EstadisticasCuadro &e = ultimoCuadro;
+    e.numero++;
+    e.msTotal = msDesde(inicioCuadro);
+    e.msFondo = msFondoMedido;
+    e.msFiguras = e.msTotal - e.msFondo;
+    e.figuras = figurasEnviadas;
+    e.puntos = puntos;
+    for (int h = 0; h < HERRAMIENTA_NINGUNA; h++) e.herramientas[h] = medicionHerramientas[h];
+    resumenCuadros.cuadros++;
+    resumenCuadros.msTotal += e.msTotal;
+    resumenCuadros.msMaximo = max(resumenCuadros.msMaximo, e.msTotal);
+    if (registroCuadros != NULL) agregarFilaRegistro(e);
+}
+
+// Figura de la herramienta actual desde el primer clic hasta (x, y), en el mundo
+Figura figuraEntrePuntos(int x, int y) {
+    Figura f;
+    f.color = colorActual;
+    f.grosor = grosorActual;
+    switch (herramientaActual) {
+        case HERRAMIENTA_LINEA_DIRECTA:
+        case HERRAMIENTA_LINEA_DDA:
+        case HERRAMIENTA_LINEA_BRESENHAM:
+        case HERRAMIENTA_LINEA_DDA_FIJO:
+            f.tipoHerramienta = herramientaActual;
+            f.xInicio = primerX;
+            f.yInicio = primerY;
+            f.xFin = x;
+            f.yFin = y;
+            break;
+        case HERRAMIENTA_CIRCULO_PUNTO_MEDIO:
+        case HERRAMIENTA_CIRCULO_RELLENO:
+            f.tipoHerramienta = herramientaActual;
+            f.centroX = primerX;
+            f.centroY = primerY;
+            f.radio = round(sqrt(pow(x - primerX, 2) + pow(y - primerY, 2)));
+            break;
+        case HERRAMIENTA_ELIPSE_PUNTO_MEDIO:
+        case HERRAMIENTA_ELIPSE_RELLENA:
+            f.tipoHerramienta = herramientaActual;
+            f.centroX = primerX;
+            f.centroY = primerY;
+            f.radioX = abs(x - primerX);
+            f.radioY = abs(y - primerY);
+            break;
+        default:
+            break;
+    }
+    return f;
+}
+
+// Dibuja en el destino actual la figura que dejaría un segundo clic en
+// (previaX, previaY); las coordenadas del destino son las de la ventana
+void dibujarVistaPrevia() {
+    if (!esperandoSegundoClick) return;
+    const TransformacionVista &t = transformacionVista;
+    truncarEscena(escenaPrevia, 0);
+    agregarAEscena(escenaPrevia, figuraEntrePuntos(mundoX(t, previaX), mundoY(t, previaY)));
+    TransformacionVista transformacionAnterior = transformacionDestino;
+    transformacionDestino = t;
+    dibujarFiguras(escenaPrevia, 0, 1);
+    transformacionDestino = transformacionAnterior;
+}
+
+// Vista previa sin ventana: copia del lienzo persistente con la figura encima
+void componerVistaPrevia(Lienzo &destino) {
+    destino.ancho = lienzoPersistente.ancho;
+    destino.alto = lienzoPersistente.alto;
+    destino.pixeles = lienzoPersistente.pixeles;
+    DestinoPixeles destinoAnterior = destinoPixeles;
+    destinoPixeles = DESTINO_LIENZO;
+    lienzoDestino = &destino;
+    dibujarVistaPrevia();
+    lienzoDestino = NULL;
+    destinoPixeles = destinoAnterior;
+}
+
+#ifndef SIN_VENTANA
+// Las figuras rellenas y, con trazos por tramos, las de grosor > 1 se
+// guardan como quads
+inline bool figuraEnQuads(const EscenaCompacta &e, size_t i) {
+    return figuraRellena(e, i) || (trazosPorTramos && grosorFigura(e, i) > 1);
+}
+
+// Dibuja las figuras de `lista` (en orden creciente) con un glDrawArrays por
+// cada tramo de figuras consecutivas con el mismo grosor (o todas en quads)
+void dibujarCacheVertices(const vector<unsigned int> &lista) {
+    const CacheVertices &c = cacheVertices;
+    if (c.vertices.empty() || lista.empty()) return;
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(2, GL_INT, 0, &c.vertices[0]);
+    glColorPointer(3, GL_UNSIGNED_BYTE, 0, &c.colores[0]);
+    size_t i = 0;
+    while (i < lista.size()) {
+        size_t j = i + 1;
+        bool quads = figuraEnQuads(figuras, lista[i]);
+        unsigned char grosor = grosorFigura(figuras, lista[i]);
+        while (j < lista.size() && lista[j] == lista[j - 1] + 1 && figuraEnQuads(figuras, lista[j]) == quads &&
+               (quads || grosorFigura(figuras, lista[j]) == grosor)) j++;
+        size_t primero = c.inicioFigura[lista[i]];
+        size_t cuenta = c.inicioFigura[lista[j - 1] + 1] - primero;
+        if (quads) {
+            glDrawArrays(GL_QUADS, primero, cuenta);
+        } else {
+            glPointSize(grosor);
+            glDrawArrays(GL_POINTS, primero, cuenta);
+        }
+        i = j;
+    }
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+void dibujarFondoGL() {
+    if (listaFondoInvalida) {
+        const TransformacionVista &t = transformacionVista;
+        if (listaFondo == 0) listaFondo = glGenLists(1);
+        glNewList(listaFondo, GL_COMPILE);
+        // Dibujar cuadrícula
+        if (mostrarCuadricula) {
+            vector<int> xs, ys;
+            posicionesCuadricula(t.escala, t.desplazamientoX, anchoViewport, xs);
+            posicionesCuadricula(t.escala, t.desplazamientoY, altoViewport, ys);
+            glColor3f(0.85f, 0.85f, 0.85f);
+            glBegin(GL_LINES);
+            for (int x : xs) {
+                glVertex2i(x, 0);
+                glVertex2i(x, altoViewport);
+            }
+            for (int y : ys) {
+                glVertex2i(0, y);
+                glVertex2i(anchoViewport, y);
+            }
+            glEnd();
+        }
+
+        // Dibujar ejes
+        if (mostrarEjes) {
+            int ex = pantallaX(t, anchoViewport / 2), ey = pantallaY(t, altoViewport / 2);
+            glColor3f(0.6f, 0.6f, 0.6f);
+            glBegin(GL_LINES);
+            glVertex2i(0, ey);
+            glVertex2i(anchoViewport, ey);
+            glVertex2i(ex, 0);
+            glVertex2i(ex, altoViewport);
+            glEnd();
+        }
+        glEndList();
+        listaFondoInvalida = false;
+    }
+    glCallList(listaFondo);
+}
+
+void dibujarTextoPantalla(int x, int y, const char *texto) {
+    glRasterPos2i(x, y);
+    for (const char *c = texto; *c; c++) glutBitmapCharacter(GLUT_BITMAP_8_BY_13, *c);
+}
+
+void dibujarEstadisticas(const EstadisticasCuadro &e) {
+    char linea[128];
+    int y = altoViewport - 16;
+    glColor3f(0.f, 0.f, 0.f);
+    snprintf(linea, sizeof(linea), "Cuadro %lu: %.2f ms (fondo %.2f, figuras %.2f)", e.numero, e.msTotal,
+             e.msFondo, e.msFiguras);
+    dibujarTextoPantalla(8, y, linea);
+    snprintf(linea, sizeof(linea), "%lu figuras, %llu puntos", (unsigned long) e.figuras, e.puntos);
+    dibujarTextoPantalla(8, y -= 15, linea);
+    for (int h = 0; h < HERRAMIENTA_NINGUNA; h++) {
+        const MedicionHerramienta &m = e.herramientas[h];
+        if (m.figuras == 0) continue;
+        snprintf(linea, sizeof(linea), "%s: %lu fig, %llu puntos, %.2f ms", NOMBRES_HERRAMIENTAS[h], m.figuras,
+                 m.puntos, m.ms);
+        dibujarTextoPantalla(8, y -= 15, linea);
+    }
+}
+
+unsigned long long verticesEnLista(const vector<unsigned int> &lista) {
+    unsigned long long n = 0;
+    for (unsigned int i : lista) n += cacheVertices.inicioFigura[i + 1] - cacheVertices.inicioFigura[i];
+    return n;
+}
+
+// Guarda el buffer trasero tal como quedó la escena, antes de la vista previa
+void capturarEscena() {
+    Lienzo &c = capturaEscena;
+    c.ancho = anchoViewport;
+    c.alto = altoViewport;
+    c.pixeles.resize((size_t) c.ancho * c.alto * 3);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadBuffer(GL_BACK);
+    glReadPixels(0, 0, c.ancho, c.alto, GL_RGB, GL_UNSIGNED_BYTE, &c.pixeles[0]);
+    capturaEscenaValida = true;
+}
+
+void redibujarTodo() {
+    if (medirCuadros) empezarCuadro();
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    dibujarFondoGL();
+    if (medirCuadros) msFondoMedido = msDesde(inicioCuadro);
+
+    // Solo las figuras que tocan la ventana. La caché no lleva el
+    // desplazamiento de la vista: lo aplica OpenGL al dibujarla
+    const TransformacionVista &t = transformacionVista;
+    Rectangulo ventana = {0, 0, anchoViewport - 1, altoViewport - 1};
+    consultarRectangulo(rectanguloEnMundo(t, ventana), figurasVisibles);
+    Rectangulo vista = {t.desplazamientoX, t.desplazamientoY, t.desplazamientoX + anchoViewport - 1,
+                        t.desplazamientoY + altoViewport - 1};
+    actualizarCacheVertices(vista);
+    glPushMatrix();
+    glTranslated(-t.desplazamientoX, -t.desplazamientoY, 0);
+    dibujarCacheVertices(figurasVisibles);
+    glPopMatrix();
+    if (esperandoSegundoClick) {
+        capturarEscena();
+        dibujarVistaPrevia();
+    }
+    if (medirCuadros) terminarCuadro(figurasVisibles.size(), verticesEnLista(figurasVisibles));
+    if (mostrarEstadisticas) dibujarEstadisticas(ultimoCuadro);
+    glutSwapBuffers();
+}
+
+// Cuadro de la vista previa: la escena sale de la captura y solo se
+// rasteriza la figura que sigue al ratón
+void presentarVistaPrevia() {
+    if (medirCuadros) empezarCuadro();
+    glRasterPos2i(0, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glDrawPixels(capturaEscena.ancho, capturaEscena.alto, GL_RGB, GL_UNSIGNED_BYTE, &capturaEscena.pixeles[0]);
+    if (medirCuadros) msFondoMedido = msDesde(inicioCuadro);
+    dibujarVistaPrevia();
+    if (medirCuadros) terminarCuadro(1, 0);
+    if (mostrarEstadisticas) dibujarEstadisticas(ultimoCuadro);
+    glutSwapBuffers();
+}
+#endif
+
+// Fondo blanco con la misma cuadrícula y ejes que dibujarFondoGL
+void construirFondoLienzo(Lienzo &fondo, int ancho, int alto, const TransformacionVista &t,
+                          bool cuadricula, bool ejes) {
+    const unsigned char gris[3] = {217, 217, 217};
+    const unsigned char grisEjes[3] = {153, 153, 153};
+    fondo.ancho = ancho;
+    fondo.alto = alto;
+    fondo.pixeles.assign((size_t) ancho * alto * 3, 255);
+    if (cuadricula) {
+        vector<int> xs, ys;
+        posicionesCuadricula(t.escala, t.desplazamientoX, ancho, xs);
+        posicionesCuadricula(t.escala, t.desplazamientoY, alto, ys);
+        for (int x : xs)
+            for (int y = 0; y < alto; y++) pintarPixelLienzo(fondo, x, y, gris);
+        for (int y : ys)
+            for (int x = 0; x < ancho; x++) pintarPixelLienzo(fondo, x, y, gris);
+    }
+    if (ejes) {
+        int ex = pantallaX(t, ancho / 2), ey = pantallaY(t, alto / 2);
+        for (int x = 0; x < ancho; x++) pintarPixelLienzo(fondo, x, ey, grisEjes);
+        for (int y = 0; y < alto; y++) pintarPixelLienzo(fondo, ex, y, grisEjes);
+    }
+}
+
+// El fondo en caché es el de transformacionDestino
+void asegurarFondoLienzo(int ancho, int alto) {
+    if (fondoLienzoInvalido || fondoLienzo.ancho != ancho || fondoLienzo.alto != alto ||
+        !mismaTransformacion(transformacionFondo, transformacionDestino)) {
+        transformacionFondo = transformacionDestino;
+        construirFondoLienzo(fondoLienzo, ancho, alto, transformacionFondo, mostrarCuadricula, mostrarEjes);
+        fondoLienzoInvalido = false;
+    }
+}
+
+// Copia la zona z del fondo propio del hilo o, si no tiene, del fondo en
+// caché, reconstruyéndolo si hace falta
+void dibujarFondoEnZona(Lienzo &lienzo, const Rectangulo &z) {
+    chrono::steady_clock::time_point t0;
+    if (medirCuadros) t0 = chrono::steady_clock::now();
+    const Lienzo *fondo = fondoHilo;
+    if (fondo == NULL) {
+        asegurarFondoLienzo(lienzo.ancho, lienzo.alto);
+        fondo = &fondoLienzo;
+    }
+    size_t bytesFila = 3 * (size_t) (z.x1 - z.x0 + 1);
+    for (int y = z.y0; y <= z.y1; y++) {
+        size_t desplazamiento = 3 * ((size_t) y * lienzo.ancho + z.x0);
+        memcpy(&lienzo.pixeles[desplazamiento], &fondo->pixeles[desplazamiento], bytesFila);
+    }
+    if (medirCuadros) msFondoMedido += chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+}
+
+void dibujarFondoLienzo(Lienzo &lienzo) {
+    Rectangulo todo = {0, 0, lienzo.ancho - 1, lienzo.alto - 1};
+    dibujarFondoEnZona(lienzo, todo);
+}
+
+// Dibuja las figuras de `lista` (en orden creciente) agrupando índices consecutivos
+void dibujarListaFiguras(const EscenaCompacta &e, const vector<unsigned int> &lista) {
+    size_t i = 0;
+    while (i < lista.size()) {
+        size_t j = i + 1;
+        while (j < lista.size() && lista[j] == lista[j - 1] + 1) j++;
+        dibujarFiguras(e, lista[i], lista[j - 1] + 1);
+        i = j;
+    }
+}
+
+// Rasteriza las figuras [desde, hasta) de e en memoria, sin contexto OpenGL
+void renderizarFigurasEnLienzo(const EscenaCompacta &e, size_t desde, size_t hasta,
+                               Lienzo &lienzo, int ancho, int alto) {
+    lienzo.ancho = ancho;
+    lienzo.alto = alto;
+    lienzo.pixeles.resize((size_t) ancho * alto * 3);
+    dibujarFondoLienzo(lienzo);
+
+    DestinoPixeles destinoAnterior = destinoPixeles;
+    destinoPixeles = DESTINO_LIENZO;
+    lienzoDestino = &lienzo;
+    dibujarFiguras(e, desde, hasta);
+    lienzoDestino = NULL;
+    destinoPixeles = destinoAnterior;
+}
+
+// Rasteriza la escena visible completa
+void renderizarEnLienzo(Lienzo &lienzo, int ancho, int alto) {
+    renderizarFigurasEnLienzo(figuras, inicioEscena, finEscena, lienzo, ancho, alto);
+}
+
+// Renderizado por teselas en paralelo
+const int TAM_TESELA = 128;
+
+// Cola de teselas de un hilo: toma las suyas por delante y, cuando se le
+// acaban, roba por detrás las de los demás
+struct ColaTeselas {
+    mutex candado;
+    deque<int> teselas;
+};
+
+struct TrabajoTeselas {
+    const EscenaCompacta *escena;
+    const Lienzo *fondo;            // NULL usa el fondo en caché
+    Lienzo *lienzo;
+    TransformacionVista vista;
+    int teselasX;
+    vector<vector<unsigned int>> figurasPorTesela;
+    vector<ColaTeselas> colas;
+};
+
+bool tomarTesela(TrabajoTeselas &t, size_t hilo, int &tesela) {
+    {
+        ColaTeselas &propia = t.colas[hilo];
+        lock_guard<mutex> bloqueo(propia.candado);
+        if (!propia.teselas.empty()) {
+            tesela = propia.teselas.front();
+            propia.teselas.pop_front();
+            return true;
+        }
+    }
+    for (size_t k = 1; k < t.colas.size(); k++) {
+        ColaTeselas &otra = t.colas[(hilo + k) % t.colas.size()];
+        lock_guard<mutex> bloqueo(otra.candado);
+        if (!otra.teselas.empty()) {
+            tesela = otra.teselas.back();
+            otra.teselas.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+// Cada tesela pinta su fondo y sus figuras en orden, recortadas a ella, así
+// que ningún píxel lo escriben dos hilos y no hacen falta candados
+void trabajarTeselas(TrabajoTeselas *t, size_t hilo) {
+    Lienzo &l = *t->lienzo;
+    destinoPixeles = DESTINO_LIENZO;
+    lienzoDestino = &l;
+    fondoHilo = t->fondo;
+    TransformacionVista transformacionAnterior = transformacionDestino;
+    transformacionDestino = t->vista;
+    int tesela;
+    while (tomarTesela(*t, hilo, tesela)) {
+        Rectangulo z;
+        z.x0 = (tesela % t->teselasX) * TAM_TESELA;
+        z.y0 = (tesela / t->teselasX) * TAM_TESELA;
+        z.x1 = min(z.x0 + TAM_TESELA, l.ancho) - 1;
+        z.y1 = min(z.y0 + TAM_TESELA, l.alto) - 1;
+        dibujarFondoEnZona(l, z);
+        recorteLienzo = z;
+        dibujarListaFiguras(*t->escena, t->figurasPorTesela[tesela]);
+    }
+    recorteLienzo.x0 = recorteLienzo.y0 = INT_MIN;
+    recorteLienzo.x1 = recorteLienzo.y1 = INT_MAX;
+    lienzoDestino = NULL;
+    fondoHilo = NULL;
+    transformacionDestino = transformacionAnterior;
+}
+
+// Descarta, además de por la caja, las teselas que la figura no toca: las
+// que una línea no cruza y las que quedan dentro o fuera del trazo de un
+// círculo, o dentro de una elipse. Con 1 px de holgura por el redondeo.
+// La zona está en píxeles; la prueba se hace en el mundo
+bool figuraTocaZona(const EscenaCompacta &e, size_t i, const TransformacionVista &vista, const Rectangulo &zona) {
+    Rectangulo z = rectanguloEnMundo(vista, zona);
+    size_t k = posicionEnLote(e.orden[i]);
+    switch (tipoFigura(e.orden[i])) {
+        case TIPO_CIRCULO: {
+            const LoteCirculos &c = e.circulos;
+            double m = c.grosor[k] / 2 + 1;
+            double x0 = z.x0 - m - c.cx[k], x1 = z.x1 + m - c.cx[k];
+            double y0 = z.y0 - m - c.cy[k], y1 = z.y1 + m - c.cy[k];
+            double cx = max(0.0, max(x0, -x1)), cy = max(0.0, max(y0, -y1));
+            double lx = max(fabs(x0), fabs(x1)), ly = max(fabs(y0), fabs(y1));
+            double dentro = c.r[k] - 1.0, fuera = c.r[k] + 1.0;
+            if (cx * cx + cy * cy > fuera * fuera) return false;
+            return c.relleno[k] || dentro <= 0 || lx * lx + ly * ly >= dentro * dentro;
+        }
+        case TIPO_ELIPSE: {
+            const LoteElipses &el = e.elipses;
+            double m = el.grosor[k] / 2 + 1;
+            double ax = el.rx[k] - el.grosor[k] / 2 - 3.0, ay = el.ry[k] - el.grosor[k] / 2 - 3.0;
+            if (el.relleno[k] || ax <= 0 || ay <= 0) return true;
+            // La elipse interior es convexa: si las 4 esquinas caen dentro, toda la zona
+            double xs[2] = {z.x0 - m - el.cx[k], z.x1 + m - el.cx[k]};
+            double ys[2] = {z.y0 - m - el.cy[k], z.y1 + m - el.cy[k]};
+            for (int a = 0; a < 2; a++)
+                for (int b = 0; b < 2; b++)
+                    if ((xs[a] / ax) * (xs[a] / ax) + (ys[b] / ay) * (ys[b] / ay) >= 1) return true;
+            return false;
+        }
+        default: {
+            const LoteLineas &l = e.lineas;
+            double t0, t1;
+            return recortarSegmento(l.x0[k], l.y0[k], l.x1[k], l.y1[k], z, l.grosor[k] + 1, t0, t1);
+        }
+    }
+}
+
+// Rasteriza las figuras [desde, hasta) de e repartiendo teselas de
+// TAM_TESELA px entre `hilos` hilos, vistas con `vista`. Con `fondo` NULL
+// se usa el fondo en caché, que es el de transformacionDestino
+void renderizarRangoParalelo(const EscenaCompacta &e, size_t desde, size_t hasta, const TransformacionVista &vista,
+                             const Lienzo *fondo, Lienzo &lienzo, int ancho, int alto, int hilos) {
+    lienzo.ancho = ancho;
+    lienzo.alto = alto;
+    lienzo.pixeles.resize((size_t) ancho * alto * 3);
+    if (fondo == NULL) asegurarFondoLienzo(ancho, alto);
+
+    TrabajoTeselas t;
+    t.escena = &e;
+    t.fondo = fondo;
+    t.lienzo = &lienzo;
+    t.vista = vista;
+    t.teselasX = (ancho + TAM_TESELA - 1) / TAM_TESELA;
+    int teselasY = (alto + TAM_TESELA - 1) / TAM_TESELA;
+    int totalTeselas = t.teselasX * teselasY;
+    t.figurasPorTesela.resize(totalTeselas);
+    for (size_t i = desde; i < hasta; i++) {
+        Rectangulo r = rectanguloEnPantalla(vista, cajaFigura(e, i));
+        if (r.x1 < 0 || r.y1 < 0 || r.x0 >= ancho || r.y0 >= alto) continue;
+        int tx0 = max(r.x0, 0) / TAM_TESELA, tx1 = min(r.x1, ancho - 1) / TAM_TESELA;
+        int ty0 = max(r.y0, 0) / TAM_TESELA, ty1 = min(r.y1, alto - 1) / TAM_TESELA;
+        for (int ty = ty0; ty <= ty1; ty++)
+            for (int tx = tx0; tx <= tx1; tx++) {
+                Rectangulo z;
+                z.x0 = tx * TAM_TESELA;
+                z.y0 = ty * TAM_TESELA;
+                z.x1 = z.x0 + TAM_TESELA - 1;
+                z.y1 = z.y0 + TAM_TESELA - 1;
+                if (figuraTocaZona(e, i, vista, z))
+                    t.figurasPorTesela[ty * t.teselasX + tx].push_back((unsigned int) i);
+            }
+    }
+
+    hilos = max(1, min(hilos, totalTeselas));
+    t.colas = vector<ColaTeselas>(hilos);
+    for (int k = 0; k < totalTeselas; k++)
+        t.colas[(size_t) k * hilos / totalTeselas].teselas.push_back(k);
+    vector<thread> trabajadores;
+    for (int h = 1; h < hilos; h++) trabajadores.push_back(thread(trabajarTeselas, &t, (size_t) h));
+    trabajarTeselas(&t, 0);
+    for (auto &th : trabajadores) th.join();
+}
+
+// Mismo resultado que renderizarEnLienzo, en paralelo
+void renderizarEnLienzoParalelo(Lienzo &lienzo, int ancho, int alto, int hilos) {
+    renderizarRangoParalelo(figuras, inicioEscena, finEscena, transformacionDestino, NULL, lienzo, ancho, alto, hilos);
+}
+
+int hilosDisponibles() {
+    return max(1, (int) thread::hardware_concurrency());
+}
+
+// Escribe el lienzo en formato PPM binario (P6), de arriba hacia abajo, fila
+// a fila por un búfer de TAM_BUFER_EXPORTACION; `filas` cuenta las escritas
+bool exportarPPM(const Lienzo &lienzo, const string &ruta, atomic<int> *filas = NULL) {
+    FILE *archivo = fopen(ruta.c_str(), "wb");
+    if (archivo == NULL) return false;
+    setvbuf(archivo, NULL, _IOFBF, TAM_BUFER_EXPORTACION);
+    bool ok = fprintf(archivo, "P6\n%d %d\n255\n", lienzo.ancho, lienzo.alto) > 0;
+    size_t bytesFila = 3 * (size_t) lienzo.ancho;
+    for (int y = lienzo.alto - 1; ok && y >= 0; y--) {
+        ok = fwrite(&lienzo.pixeles[bytesFila * y], 1, bytesFila, archivo) == bytesFila;
+        if (filas != NULL) (*filas)++;
+    }
+    return fclose(archivo) == 0 && ok;
+}
+
+
+const char *extensionFormato(FormatoImagen formato) {
+    switch (formato) {
+        case FORMATO_QOI: return ".qoi";
+        case FORMATO_PNG: return ".png";
+        default: return ".ppm";
+    }
+}
+
+void escribirBE32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char) (v >> 24);
+    p[1] = (unsigned char) (v >> 16);
+    p[2] = (unsigned char) (v >> 8);
+    p[3] = (unsigned char) v;
+}
+
+// Una fila del lienzo es de un solo color si cada byte es igual al del píxel siguiente
+bool filaUniforme(const unsigned char *fila, int ancho) {
+    return ancho <= 1 || memcmp(fila, fila + 3, 3 * (size_t) (ancho - 1)) == 0;
+}
+
+// QOI (qoiformat.org): cada píxel se codifica como repetición del anterior
+// (tramos de hasta 62), índice en una tabla de 64 colores vistos, diferencia
+// pequeña con el anterior o RGB completo. El alfa es siempre 255
+const unsigned char QOI_OP_INDEX = 0x00;
+const unsigned char QOI_OP_DIFF = 0x40;
+const unsigned char QOI_OP_LUMA = 0x80;
+const unsigned char QOI_OP_RUN = 0xc0;
+const unsigned char QOI_OP_RGB = 0xfe;
+const int QOI_TRAMO_MAXIMO = 62;
+
+bool exportarQOI(const Lienzo &lienzo, const string &ruta, atomic<int> *filas = NULL) {
+    FILE *archivo = fopen(ruta.c_str(), "wb");
+    if (archivo == NULL) return false;
+    setvbuf(archivo, NULL, _IOFBF, TAM_BUFER_EXPORTACION);
+    unsigned char cabecera[14] = {'q', 'o', 'i', 'f'};
+    escribirBE32(cabecera + 4, (uint32_t) lienzo.ancho);
+    escribirBE32(cabecera + 8, (uint32_t) lienzo.alto);
+    cabecera[12] = 3;       // RGB
+    cabecera[13] = 0;       // sRGB
+    bool ok = fwrite(cabecera, 1, sizeof(cabecera), archivo) == sizeof(cabecera);
+
+    // Colores empaquetados con r en el byte bajo y alfa en el alto; una
+    // entrada vacía (alfa 0) nunca coincide con un píxel
+    uint32_t vistos[64] = {0};
+    uint32_t anterior = 0xff000000u;
+    int tramo = 0;
+    vector<unsigned char> salida(4 * (size_t) lienzo.ancho + 16);
+    size_t bytesFila = 3 * (size_t) lienzo.ancho;
+    for (int y = lienzo.alto - 1; ok && y >= 0; y--) {
+        const unsigned char *fila = &lienzo.pixeles[bytesFila * y];
+        size_t n = 0;
+        uint32_t primero = lienzo.ancho > 0 ? fila[0] | fila[1] << 8 | fila[2] << 16 | 0xff000000u : anterior;
+        if (primero == anterior && filaUniforme(fila, lienzo.ancho)) {
+            // Fila entera del color anterior (casi siempre el fondo blanco):
+            // se suma al tramo sin mirar píxel por píxel
+            tramo += lienzo.ancho;
+            while (tramo >= QOI_TRAMO_MAXIMO) {
+                salida[n++] = QOI_OP_RUN | (QOI_TRAMO_MAXIMO - 1);
+                tramo -= QOI_TRAMO_MAXIMO;
+            }
+        } else {
+            for (int x = 0; x < lienzo.ancho; x++) {
+                unsigned char r = fila[3 * x], g = fila[3 * x + 1], b = fila[3 * x + 2];
+                uint32_t p = r | g << 8 | b << 16 | 0xff000000u;
+                if (p == anterior) {
+                    if (++tramo == QOI_TRAMO_MAXIMO) {
+                        salida[n++] = QOI_OP_RUN | (QOI_TRAMO_MAXIMO - 1);
+                        tramo = 0;
+                    }
+                    continue;
+                }
+                if (tramo > 0) {
+                    salida[n++] = QOI_OP_RUN | (tramo - 1);
+                    tramo = 0;
+                }
+                int h = (r * 3 + g * 5 + b * 7 + 255 * 11) % 64;
+                if (vistos[h] == p) {
+                    salida[n++] = QOI_OP_INDEX | h;
+                } else {
+                    vistos[h] = p;
+                    signed char dr = (signed char) (r - (anterior & 0xff));
+                    signed char dg = (signed char) (g - (anterior >> 8 & 0xff));
+                    signed char db = (signed char) (b - (anterior >> 16 & 0xff));
+                    int drg = dr - dg, dbg = db - dg;
+                    if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                        salida[n++] = QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2);
+                    } else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7) {
+                        salida[n++] = QOI_OP_LUMA | (dg + 32);
+                        salida[n++] = (unsigned char) ((drg + 8) << 4 | (dbg + 8));
+                    } else {
+                        salida[n++] = QOI_OP_RGB;
+                        salida[n++] = r;
+                        salida[n++] = g;
+                        salida[n++] = b;
+                    }
+                }
+                anterior = p;
+            }
+        }
+        ok = fwrite(&salida[0], 1, n, archivo) == n;
+        if (filas != NULL) (*filas)++;
+    }
+    const unsigned char cierre[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+    if (ok && tramo > 0) ok = fputc(QOI_OP_RUN | (tramo - 1), archivo) != EOF;
+    if (ok) ok = fwrite(cierre, 1, sizeof(cierre), archivo) == sizeof(cierre);
+    return fclose(archivo) == 0 && ok;
+}
+
+// PNG RGB de 8 bits. Una fila que repite la anterior se filtra con Up y
+// queda en ceros (el fondo, las líneas verticales): esas no pasan por la
+// búsqueda. Las demás se filtran con Sub o Up, el de menor suma. El
+// deflate es el más rápido posible: una sola candidata por hash de 3 bytes
+// en una ventana de 32 KB y los códigos de Huffman fijos. Cada fila va en
+// su propio bloque, guardado sin comprimir cuando así ocupa menos
+const uint8_t FIRMA_PNG[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+const size_t TAM_IDAT = 1 << 16;
+const int DEFLATE_LARGO_MAXIMO = 258;
+const size_t DEFLATE_VENTANA = 32768;
+const size_t DEFLATE_GUARDADO_MAXIMO = 65535;
+const int BITS_HASH_DEFLATE = 15;
+
+// Códigos fijos ya invertidos, porque deflate escribe primero el bit bajo;
+// los de largo y distancia llevan pegados sus bits extra
+struct TablasPNG {
+    uint32_t crc[256];
+    uint32_t codigoLiteral[257];
+    int bitsLiteral[257];
+    uint32_t codigoLargo[DEFLATE_LARGO_MAXIMO + 1];
+    int bitsLargo[DEFLATE_LARGO_MAXIMO + 1];
+    vector<uint32_t> codigoDistancia;
+    vector<unsigned char> bitsDistancia;
+};
+
+uint32_t invertirBits(uint32_t v, int n) {
+    uint32_t r = 0;
+    for (int i = 0; i < n; i++) r |= (v >> i & 1) << (n - 1 - i);
+    return r;
+}
+
+TablasPNG construirTablasPNG() {
+    TablasPNG t;
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        t.crc[i] = c;
+    }
+    for (int s = 0; s <= 256; s++) {
+        if (s < 144) t.codigoLiteral[s] = invertirBits(0x30 + s, t.bitsLiteral[s] = 8);
+        else if (s < 256) t.codigoLiteral[s] = invertirBits(0x190 + s - 144, t.bitsLiteral[s] = 9);
+        else t.codigoLiteral[s] = invertirBits(0, t.bitsLiteral[s] = 7);
+    }
+    const int baseLargo[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                               35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    const int extraLargo[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    for (int largo = 3; largo <= DEFLATE_LARGO_MAXIMO; largo++) {
+        int k = 28;
+        while (baseLargo[k] > largo) k--;
+        int s = 257 + k, bits;
+        uint32_t codigo = s < 280 ? invertirBits(s - 256, bits = 7) : invertirBits(0xc0 + s - 280, bits = 8);
+        t.codigoLargo[largo] = codigo | (uint32_t) (largo - baseLargo[k]) << bits;
+        t.bitsLargo[largo] = bits + extraLargo[k];
+    }
+    const int baseDistancia[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                   257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+    t.codigoDistancia.resize(DEFLATE_VENTANA + 1);
+    t.bitsDistancia.resize(DEFLATE_VENTANA + 1);
+    int k = 0;
+    for (int d = 1; d <= (int) DEFLATE_VENTANA; d++) {
+        if (k < 29 && baseDistancia[k + 1] <= d) k++;
+        int extra = k < 4 ? 0 : k / 2 - 1;
+        t.codigoDistancia[d] = invertirBits(k, 5) | (uint32_t) (d - baseDistancia[k]) << 5;
+        t.bitsDistancia[d] = (unsigned char) (5 + extra);
+    }
+    return t;
+}
+
+const TablasPNG &tablasPNG() {
+    static const TablasPNG t = construirTablasPNG();
+    return t;
+}
+
+uint32_t actualizarCRC(uint32_t crc, const unsigned char *p, size_t n) {
+    const TablasPNG &t = tablasPNG();
+    for (size_t i = 0; i < n; i++) crc = t.crc[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+bool escribirFragmentoPNG(FILE *archivo, const char *tipo, const unsigned char *datos, size_t n) {
+    unsigned char largo[4];
+    escribirBE32(largo, (uint32_t) n);
+    uint32_t crc = actualizarCRC(0xffffffffu, (const unsigned char *) tipo, 4);
+    if (n > 0) crc = actualizarCRC(crc, datos, n);
+    unsigned char suma[4];
+    escribirBE32(suma, crc ^ 0xffffffffu);
+    return fwrite(largo, 1, 4, archivo) == 4 && fwrite(tipo, 1, 4, archivo) == 4 &&
+           (n == 0 || fwrite(datos, 1, n, archivo) == n) && fwrite(suma, 1, 4, archivo) == 4;
+}
+
+// Flujo zlib en construcción: bits pendientes, bytes aún sin escribir y la
+// ventana de bytes sin comprimir donde se buscan repeticiones
+struct FlujoDeflate {
+    vector<unsigned char> bytes;
+    uint64_t acumulado;
+    int bits;
+    uint32_t adlerA, adlerB;
+    vector<unsigned char> ventana;
+    long long base;                     // posición en el flujo de ventana[0]
+    vector<long long> ultimaPosicion;   // por hash de 3 bytes; -1 si no hubo
+    vector<uint32_t> simbolos;          // de la fila: byte, o distancia << 16 | largo
+    vector<uint32_t> simbolosRepetida;  // los de una fila Up toda en ceros, calculados una vez
+    size_t bitsRepetida;
+};
+
+// Los bits se juntan de a 32 antes de pasar a `bytes`
+inline void ponerBits(FlujoDeflate &f, uint32_t valor, int n) {
+    f.acumulado |= (uint64_t) valor << f.bits;
+    f.bits += n;
+    if (f.bits >= 32) {
+        unsigned char b[4] = {(unsigned char) f.acumulado, (unsigned char) (f.acumulado >> 8),
+                              (unsigned char) (f.acumulado >> 16), (unsigned char) (f.acumulado >> 24)};
+        f.bytes.insert(f.bytes.end(), b, b + 4);
+        f.acumulado >>= 32;
+        f.bits -= 32;
+    }
+}
+
+// Completa el byte en curso con ceros y pasa a `bytes` los bits pendientes
+void alinearBits(FlujoDeflate &f) {
+    f.bits = (f.bits + 7) & ~7;
+    for (; f.bits > 0; f.bits -= 8) {
+        f.bytes.push_back((unsigned char) f.acumulado);
+        f.acumulado >>= 8;
+    }
+    f.acumulado = 0;
+}
+
+// Adler-32 de a 16 bytes: B suma 16 veces A más los bytes pesados por su
+// distancia al final, sin la dependencia de byte a byte
+void actualizarAdler(FlujoDeflate &f, const unsigned char *p, size_t n) {
+    while (n > 0) {
+        size_t bloque = min(n, (size_t) 5552);      // sin desbordar 32 bits
+        size_t i = 0;
+        for (; i + 16 <= bloque; i += 16) {
+            uint32_t suma = 0, pesada = 0;
+            for (int k = 0; k < 16; k++) {
+                suma += p[i + k];
+                pesada += (uint32_t) (16 - k) * p[i + k];
+            }
+            f.adlerB += 16 * f.adlerA + pesada;
+            f.adlerA += suma;
+        }
+        for (; i < bloque; i++) {
+            f.adlerA += p[i];
+            f.adlerB += f.adlerA;
+        }
+        f.adlerA %= 65521;
+        f.adlerB %= 65521;
+        p += bloque;
+        n -= bloque;
+    }
+}
+
+// Escribe la fila d como un bloque no final: con los símbolos ya buscados
+// y Huffman fijo, o tal cual si así ocupa menos
+void emitirBloquePNG(FlujoDeflate &f, const vector<uint32_t> &simbolos, size_t bitsFijos,
+                     const unsigned char *d, size_t n) {
+    const TablasPNG &t = tablasPNG();
+    size_t bloquesGuardados = (n + DEFLATE_GUARDADO_MAXIMO - 1) / DEFLATE_GUARDADO_MAXIMO;
+    size_t bitsGuardados = bloquesGuardados * (3 + 7 + 32) + 8 * n;
+    if (bitsFijos <= bitsGuardados) {
+        ponerBits(f, 2, 3);     // BFINAL 0, BTYPE 01 (Huffman fijo)
+        for (uint32_t s : simbolos) {
+            uint32_t distancia = s >> 16;
+            if (distancia == 0) {
+                ponerBits(f, t.codigoLiteral[s], t.bitsLiteral[s]);
+            } else {
+                ponerBits(f, t.codigoLargo[s & 0xffff], t.bitsLargo[s & 0xffff]);
+                ponerBits(f, t.codigoDistancia[distancia], t.bitsDistancia[distancia]);
+            }
+        }
+        ponerBits(f, t.codigoLiteral[256], t.bitsLiteral[256]);
+    } else {
+        for (size_t desde = 0; desde < n; desde += DEFLATE_GUARDADO_MAXIMO) {
+            size_t largo = min(n - desde, DEFLATE_GUARDADO_MAXIMO);
+            ponerBits(f, 0, 3);     // BFINAL 0, BTYPE 00 (sin comprimir)
+            alinearBits(f);
+            ponerBits(f, (uint32_t) largo, 16);
+            ponerBits(f, (uint32_t) largo ^ 0xffff, 16);
+            f.bytes.insert(f.bytes.end(), d + desde, d + desde + largo);
+        }
+    }
+}
+
+// Agrega la fila a la ventana y devuelve dónde empieza dentro de ella
+size_t agregarAVentana(FlujoDeflate &f, const unsigned char *d, size_t n) {
+    if (f.ventana.size() > 2 * DEFLATE_VENTANA) {
+        size_t quitar = f.ventana.size() - DEFLATE_VENTANA;
+        f.ventana.erase(f.ventana.begin(), f.ventana.begin() + quitar);
+        f.base += quitar;
+    }
+    size_t inicio = f.ventana.size();
+    f.ventana.insert(f.ventana.end(), d, d + n);
+    return inicio;
+}
+
+// Comprime una fila ya filtrada como un bloque deflate no final
+void comprimirFilaPNG(FlujoDeflate &f, const unsigned char *d, size_t n) {
+    const TablasPNG &t = tablasPNG();
+    actualizarAdler(f, d, n);
+    size_t inicio = agregarAVentana(f, d, n);
+    const unsigned char *v = &f.ventana[0];
+
+    f.simbolos.clear();
+    size_t bitsFijos = 3 + t.bitsLiteral[256];
+    size_t i = 0;
+    while (i < n) {
+        size_t largo = 0, distancia = 0;
+        if (n - i >= 3) {
+            size_t p = inicio + i;
+            uint32_t h = ((uint32_t) v[p] << 10 ^ (uint32_t) v[p + 1] << 5 ^ v[p + 2]) & ((1u << BITS_HASH_DEFLATE) - 1);
+            long long candidata = f.ultimaPosicion[h] - f.base;
+            f.ultimaPosicion[h] = f.base + (long long) p;
+            if (candidata >= 0 && p - (size_t) candidata <= DEFLATE_VENTANA) {
+                size_t maximo = min(n - i, (size_t) DEFLATE_LARGO_MAXIMO);
+                while (largo < maximo && v[candidata + largo] == v[p + largo]) largo++;
+                distancia = p - (size_t) candidata;
+            }
+        }
+        if (largo >= 3) {
+            f.simbolos.push_back((uint32_t) distancia << 16 | (uint32_t) largo);
+            bitsFijos += t.bitsLargo[largo] + t.bitsDistancia[distancia];
+            i += largo;
+        } else {
+            f.simbolos.push_back(d[i]);
+            bitsFijos += t.bitsLiteral[d[i]];
+            i++;
+        }
+    }
+    emitirBloquePNG(f, f.simbolos, bitsFijos, d, n);
+}
+
+// Fila igual a la anterior: filtrada con Up es un 2 y n - 1 ceros, que se
+// codifican siempre igual (el 2, un 0 y repeticiones del byte anterior) sin
+// buscar en la ventana. Los símbolos se arman con la primera de estas filas
+void comprimirFilaRepetidaPNG(FlujoDeflate &f, const unsigned char *ceros, size_t n) {
+    const TablasPNG &t = tablasPNG();
+    if (f.simbolosRepetida.empty()) {
+        f.simbolosRepetida.push_back(2);
+        f.bitsRepetida = 3 + t.bitsLiteral[256] + t.bitsLiteral[2];
+        size_t restantes = n - 1;
+        if (restantes > 0) {
+            f.simbolosRepetida.push_back(0);
+            f.bitsRepetida += t.bitsLiteral[0];
+            restantes--;
+        }
+        while (restantes >= 3) {
+            size_t largo = min(restantes, (size_t) DEFLATE_LARGO_MAXIMO);
+            f.simbolosRepetida.push_back(1u << 16 | (uint32_t) largo);
+            f.bitsRepetida += t.bitsLargo[largo] + t.bitsDistancia[1];
+            restantes -= largo;
+        }
+        for (; restantes > 0; restantes--) {
+            f.simbolosRepetida.push_back(0);
+            f.bitsRepetida += t.bitsLiteral[0];
+        }
+    }
+    // Adler-32 de un 2 seguido de n - 1 ceros
+    f.adlerA = (f.adlerA + 2) % 65521;
+    f.adlerB = (uint32_t) ((f.adlerB + (uint64_t) f.adlerA * n) % 65521);
+    agregarAVentana(f, ceros, n);
+    emitirBloquePNG(f, f.simbolosRepetida, f.bitsRepetida, ceros, n);
+}
+
+// d = a - b byte a byte; devuelve la suma de |d| leyendo d con signo, la
+// medida habitual para elegir el filtro. Por bloques fijos de 16 bytes, que
+// el compilador puede vectorizar
+unsigned long restarFilas(unsigned char *d, const unsigned char *a, const unsigned char *b, size_t n) {
+    unsigned long suma = 0;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        unsigned char v[16];
+        for (int k = 0; k < 16; k++) v[k] = (unsigned char) (a[i + k] - b[i + k]);
+        memcpy(d + i, v, 16);
+        unsigned int parcial = 0;
+        for (int k = 0; k < 16; k++) parcial += (unsigned int) abs((signed char) v[k]);
+        suma += parcial;
+    }
+    for (; i < n; i++) {
+        d[i] = (unsigned char) (a[i] - b[i]);
+        suma += (unsigned long) abs((signed char) d[i]);
+    }
+    return suma;
+}
+
+bool exportarPNG(const Lienzo &lienzo, const string &ruta, atomic<int> *filas = NULL) {
+    FILE *archivo = fopen(ruta.c_str(), "wb");
+    if (archivo == NULL) return false;
+    setvbuf(archivo, NULL, _IOFBF, TAM_BUFER_EXPORTACION);
+    unsigned char cabecera[13];
+    escribirBE32(cabecera, (uint32_t) lienzo.ancho);
+    escribirBE32(cabecera + 4, (uint32_t) lienzo.alto);
+    cabecera[8] = 8;        // bits por canal
+    cabecera[9] = 2;        // RGB
+    cabecera[10] = cabecera[11] = cabecera[12] = 0;
+    bool ok = fwrite(FIRMA_PNG, 1, sizeof(FIRMA_PNG), archivo) == sizeof(FIRMA_PNG) &&
+              escribirFragmentoPNG(archivo, "IHDR", cabecera, sizeof(cabecera));
+
+    FlujoDeflate f;
+    f.acumulado = 0;
+    f.bits = 0;
+    f.adlerA = 1;
+    f.adlerB = 0;
+    f.base = 0;
+    f.ultimaPosicion.assign((size_t) 1 << BITS_HASH_DEFLATE, -1);
+    f.bytes.reserve(2 * TAM_IDAT);
+    f.bytes.push_back(0x78);    // zlib: deflate con ventana de 32 KB
+    f.bytes.push_back(0x01);
+    size_t bytesFila = 3 * (size_t) lienzo.ancho;
+    vector<unsigned char> filtrada(bytesFila + 1), arriba(bytesFila + 1), ceros(bytesFila + 1, 0);
+    ceros[0] = 2;               // Up
+    const unsigned char *filaAnterior = NULL;
+    for (int y = lienzo.alto - 1; ok && y >= 0; y--) {
+        const unsigned char *fila = &lienzo.pixeles[bytesFila * y];
+        if (filaAnterior != NULL && memcmp(fila, filaAnterior, bytesFila) == 0) {
+            // Fila repetida, casi siempre de fondo: ya se sabe que Up da ceros
+            comprimirFilaRepetidaPNG(f, &ceros[0], ceros.size());
+        } else {
+            // Sub o Up, el de menor suma de diferencias en valor absoluto
+            const unsigned char *previa = filaAnterior != NULL ? filaAnterior : &ceros[1];
+            size_t primeros = min(bytesFila, (size_t) 3);
+            filtrada[0] = 1;    // Sub
+            arriba[0] = 2;      // Up
+            unsigned long sumaSub = restarFilas(&filtrada[1], fila, &ceros[1], primeros) +
+                                    restarFilas(&filtrada[1 + primeros], fila + primeros, fila, bytesFila - primeros);
+            unsigned long sumaArriba = restarFilas(&arriba[1], fila, previa, bytesFila);
+            comprimirFilaPNG(f, sumaSub <= sumaArriba ? &filtrada[0] : &arriba[0], filtrada.size());
+        }
+        filaAnterior = fila;
+        if (f.bytes.size() >= TAM_IDAT) {
+            ok = escribirFragmentoPNG(archivo, "IDAT", &f.bytes[0], f.bytes.size());
+            f.bytes.clear();
+        }
+        if (filas != NULL) (*filas)++;
+    }
+    ponerBits(f, 3, 3);         // bloque final vacío con Huffman fijo
+    ponerBits(f, tablasPNG().codigoLiteral[256], tablasPNG().bitsLiteral[256]);
+    alinearBits(f);
+    unsigned char adler[4];
+    escribirBE32(adler, f.adlerB << 16 | f.adlerA);
+    f.bytes.insert(f.bytes.end(), adler, adler + 4);
+    if (ok) ok = escribirFragmentoPNG(archivo, "IDAT", &f.bytes[0], f.bytes.size()) &&
+                 escribirFragmentoPNG(archivo, "IEND", NULL, 0);
+    return fclose(archivo) == 0 && ok;
+}
+
+bool exportarImagen(const Lienzo &lienzo, const string &ruta, FormatoImagen formato, atomic<int> *filas = NULL) {
+    switch (formato) {
+        case FORMATO_QOI: return exportarQOI(lienzo, ruta, filas);
+        case FORMATO_PNG: return exportarPNG(lienzo, ruta, filas);
+        default: return exportarPPM(lienzo, ruta, filas);
+    }
+}
 
-Herramienta herramientaActual = HERRAMIENTA_LINEA_DIRECTA;
-ColorRGB colorActual = {0.f, 0.f, 0.f};
-int grosorActual = 1;
-bool mostrarCuadricula = true;
-bool mostrarEjes = true;
-bool esperandoSegundoClick = false;
-int primerX = 0;
-int primerY = 0;
-int anchoViewport = ANCHO_VENTANA;
-int altoViewport = ALTO_VENTANA;
+// Tamaño de un archivo ya escrito; 0 si no se puede abrir
+long tamanoArchivo(const string &ruta) {
+    FILE *archivo = fopen(ruta.c_str(), "rb");
+    if (archivo == NULL) return 0;
+    fseek(archivo, 0, SEEK_END);
+    long tam = ftell(archivo);
+    fclose(archivo);
+    return tam;
+}
+
+// Hilo de exportación: atiende la cola en orden. candadoEscena solo se
+// retiene mientras se copia el rango; rasterizar y escribir no bloquean la
+// interfaz aunque entretanto se agreguen, borren o carguen figuras
+void trabajarExportaciones() {
+    for (;;) {
+        {
+            unique_lock<mutex> espera(candadoExportaciones);
+            hayExportacion.wait(espera, [] { return !colaExportaciones.empty() || cerrandoExportaciones; });
+            if (colaExportaciones.empty()) return;
+        }
+        TrabajoExportacion t;
+        {
+            lock_guard<mutex> bloqueoEscena(candadoEscena);
+            {
+                lock_guard<mutex> bloqueo(candadoExportaciones);
+                t = move(colaExportaciones.front());
+                colaExportaciones.pop_front();
+                exportando = true;
+            }
+            if (!t.copiaPropia) {
+                copiarRangoEscena(figuras, t.desde, t.hasta, t.copia);
+                t.hasta -= t.desde;
+                t.desde = 0;
+                t.copiaPropia = true;
+            }
+        }
+        filasExportadas = 0;
+        filasPorExportar = t.alto;
 
-inline int redondearAEntero(float v) {
-    return (int) floor(v + 0.5f);
+        auto t0 = chrono::steady_clock::now();
+        Lienzo fondo, lienzo;
+        construirFondoLienzo(fondo, t.ancho, t.alto, t.vista, t.cuadricula, t.ejes);
+        renderizarRangoParalelo(t.copia, t.desde, t.hasta, t.vista, &fondo, lienzo, t.ancho, t.alto,
+                                hilosDisponibles());
+        double msRasterizado = msDesde(t0);
+        bool ok = exportarImagen(lienzo, t.ruta, t.formato, &filasExportadas);
+        double ms = msDesde(t0);
+        // El ritmo se cuenta sobre los píxeles, para comparar formatos
+        double mb = 3.0 * t.ancho * t.alto / 1048576.0;
+        if (ok)
+            cout << "Imagen exportada en " << t.ruta << ": " << tamanoArchivo(t.ruta) / 1048576.0 << " MB de "
+                 << mb << " MB de píxeles en " << ms << " ms (rasterizado " << msRasterizado << " ms), "
+                 << (ms > 0 ? mb / (ms / 1000) : 0) << " MB/s" << endl;
+        else cerr << "No se pudo escribir " << t.ruta << endl;
+        {
+            lock_guard<mutex> bloqueo(candadoExportaciones);
+            exportando = false;
+        }
+        exportacionTerminada.notify_all();
+    }
 }
 
-// Gestión Deshacer/Rehacer
-void guardarParaDeshacer() {
-    pilaDeshacer.push(figuras);
-    while (!pilaRehacer.empty()) pilaRehacer.pop();
+// Espera a que terminen las exportaciones en cola
+void esperarExportaciones() {
+    unique_lock<mutex> espera(candadoExportaciones);
+    exportacionTerminada.wait(espera, [] { return colaExportaciones.empty() && !exportando; });
 }
 
-void deshacer() {
-    if (!pilaDeshacer.empty()) {
-        pilaRehacer.push(figuras);
-        figuras = pilaDeshacer.top();
-        pilaDeshacer.pop();
-        glutPostRedisplay();
+// Al salir se termina lo que quede en cola antes de cerrar el hilo
+void cerrarExportaciones() {
+    {
+        lock_guard<mutex> bloqueo(candadoExportaciones);
+        cerrandoExportaciones = true;
     }
+    hayExportacion.notify_one();
+    if (hiloExportacion.joinable()) hiloExportacion.join();
 }
 
-void rehacer() {
-    if (!pilaRehacer.empty()) {
-        pilaDeshacer.push(figuras);
-        figuras = pilaRehacer.top();
-        pilaRehacer.pop();
-        glutPostRedisplay();
+// Pone en cola la exportación de la escena visible tal como está ahora, con
+// el zoom y el desplazamiento de la ventana, y vuelve enseguida; si ya hay una en curso, esta espera su turno
+void exportarEscena(const string &ruta, FormatoImagen formato) {
+    TrabajoExportacion t;
+    t.ruta = ruta;
+    t.formato = formato;
+    t.copiaPropia = false;
+    t.desde = inicioEscena;
+    t.hasta = finEscena;
+    t.ancho = anchoViewport;
+    t.alto = altoViewport;
+    t.vista = transformacionVista;
+    t.cuadricula = mostrarCuadricula;
+    t.ejes = mostrarEjes;
+    size_t pendientes;
+    {
+        lock_guard<mutex> bloqueo(candadoExportaciones);
+        if (!hiloExportacion.joinable()) {
+            hiloExportacion = thread(trabajarExportaciones);
+            atexit(cerrarExportaciones);
+        }
+        colaExportaciones.push_back(move(t));
+        pendientes = colaExportaciones.size() + exportando;
     }
+    hayExportacion.notify_one();
+    if (pendientes > 1) cout << "Exportación de " << ruta << " en cola (" << pendientes - 1 << " antes)" << endl;
 }
 
-void dibujarPunto(int x, int y) {
-    glVertex2i(x, y);
+// Progreso en el título de la ventana mientras quede alguna exportación
+void mostrarProgresoExportacion(int) {
+    size_t pendientes;
+    {
+        lock_guard<mutex> bloqueo(candadoExportaciones);
+        pendientes = colaExportaciones.size() + exportando;
+    }
+    if (pendientes == 0) {
+        progresoExportacionVisible = false;
+        glutSetWindowTitle("Proyecto de unidad - DMV");
+        return;
+    }
+    int total = filasPorExportar, hechas = filasExportadas;
+    char titulo[96];
+    snprintf(titulo, sizeof(titulo), "Proyecto de unidad - DMV (exportando %d%%, %zu en cola)",
+             total > 0 ? 100 * hechas / total : 0, pendientes - 1);
+    glutSetWindowTitle(titulo);
+    progresoExportacionVisible = true;
+    glutTimerFunc(200, mostrarProgresoExportacion, 0);
 }
 
-void dibujarLineaDirecta(int x0, int y0, int x1, int y1, int grosor) {
-    int dx = x1 - x0;
-    int dy = y1 - y0;
-    int pasos = max(abs(dx), abs(dy));
+// Archivo de escena binario: cabecera fija y después los arreglos de
+// EscenaCompacta tal cual, cada uno alineado a 8 bytes y en este orden:
+// orden; x0 y0 x1 y1 color grosor herramienta de las líneas; cx cy r color
+// grosor relleno de los círculos; cx cy rx ry color grosor relleno de las
+// elipses. `suma` cubre todo lo que sigue a la cabecera
+const char MAGIA_ESCENA[8] = {'D', 'M', 'V', 'E', 'S', 'C', 'N', 0};
+const uint32_t VERSION_ESCENA = 1;
+const uint32_t MARCA_ORDEN_BYTES = 0x01020304;
 
-    float xInc = dx / (float) pasos;
-    float yInc = dy / (float) pasos;
+struct CabeceraEscena {
+    char magia[8];
+    uint32_t version;
+    uint32_t marcaOrdenBytes;       // distingue archivos de otra arquitectura
+    uint64_t figuras, lineas, circulos, elipses;
+    uint64_t suma;
+};
+
+string rutaEscena = "escena.dmv";
 
-    float x = x0;
-    float y = y0;
+inline size_t alinear8(size_t n) {
+    return (n + 7) & ~(size_t) 7;
+}
 
-    glPointSize(grosor);
-    glBegin(GL_POINTS);
-    for (int i = 0; i <= pasos; i++) {
-        dibujarPunto(redondearAEntero(x), redondearAEntero(y));
-        x += xInc;
-        y += yInc;
+// FNV-1a sobre palabras de 64 bits; el último trozo se completa con ceros
+uint64_t sumarBloque(uint64_t suma, const unsigned char *datos, size_t n) {
+    for (size_t i = 0; i < n; i += 8) {
+        uint64_t palabra = 0;
+        memcpy(&palabra, datos + i, min((size_t) 8, n - i));
+        suma = (suma ^ palabra) * 1099511628211ULL;
     }
-    glEnd();
+    return suma;
+}
+
+template <class T>
+void escribirArreglo(ofstream &archivo, const vector<T> &v, size_t desde, size_t n, uint64_t &suma) {
+    static const char ceros[8] = {0};
+    const unsigned char *datos = (const unsigned char *) (v.empty() ? NULL : &v[desde]);
+    size_t bytes = n * sizeof(T);
+    if (bytes) archivo.write((const char *) datos, bytes);
+    archivo.write(ceros, alinear8(bytes) - bytes);
+    suma = sumarBloque(suma, datos, bytes);
 }
 
-void dibujarLineaDDA(int x0, int y0, int x1, int y1, int grosor) {
-    int dx = x1 - x0, dy = y1 - y0;
-    int pasos = max(abs(dx), abs(dy));
-    float x = x0, y = y0;
-    float incX = dx / (float) pasos;
-    float incY = dy / (float) pasos;
-    glPointSize(grosor);
-    glBegin(GL_POINTS);
-    for (int i = 0; i <= pasos; i++) {
-        dibujarPunto(redondearAEntero(x), redondearAEntero(y));
-        x += incX;
-        y += incY;
+// Guarda las figuras visibles. Como orden es creciente dentro de cada lote,
+// las de cada tipo ocupan un tramo contiguo que empieza en primera[tipo]
+bool guardarEscena(const string &ruta) {
+    const EscenaCompacta &e = figuras;
+    size_t primera[3] = {e.lineas.x0.size(), e.circulos.cx.size(), e.elipses.cx.size()};
+    size_t cantidad[3] = {0, 0, 0};
+    for (size_t i = inicioEscena; i < finEscena; i++) {
+        TipoFigura t = tipoFigura(e.orden[i]);
+        if (cantidad[t]++ == 0) primera[t] = posicionEnLote(e.orden[i]);
     }
-    glEnd();
+    vector<unsigned int> orden(finEscena - inicioEscena);
+    for (size_t i = inicioEscena; i < finEscena; i++)
+        orden[i - inicioEscena] = e.orden[i] - (unsigned int) primera[tipoFigura(e.orden[i])];
+
+    ofstream archivo(ruta.c_str(), ios::binary);
+    if (!archivo) return false;
+    CabeceraEscena c;
+    memcpy(c.magia, MAGIA_ESCENA, sizeof(c.magia));
+    c.version = VERSION_ESCENA;
+    c.marcaOrdenBytes = MARCA_ORDEN_BYTES;
+    c.figuras = orden.size();
+    c.lineas = cantidad[TIPO_LINEA];
+    c.circulos = cantidad[TIPO_CIRCULO];
+    c.elipses = cantidad[TIPO_ELIPSE];
+    c.suma = 14695981039346656037ULL;
+    archivo.write((const char *) &c, sizeof(c));
+
+    const LoteLineas &l = e.lineas;
+    size_t pl = primera[TIPO_LINEA], nl = cantidad[TIPO_LINEA];
+    const LoteCirculos &ci = e.circulos;
+    size_t pc = primera[TIPO_CIRCULO], nc = cantidad[TIPO_CIRCULO];
+    const LoteElipses &el = e.elipses;
+    size_t pe = primera[TIPO_ELIPSE], ne = cantidad[TIPO_ELIPSE];
+    escribirArreglo(archivo, orden, 0, orden.size(), c.suma);
+    escribirArreglo(archivo, l.x0, pl, nl, c.suma);
+    escribirArreglo(archivo, l.y0, pl, nl, c.suma);
+    escribirArreglo(archivo, l.x1, pl, nl, c.suma);
+    escribirArreglo(archivo, l.y1, pl, nl, c.suma);
+    escribirArreglo(archivo, l.color, pl, nl, c.suma);
+    escribirArreglo(archivo, l.grosor, pl, nl, c.suma);
+    escribirArreglo(archivo, l.herramienta, pl, nl, c.suma);
+    escribirArreglo(archivo, ci.cx, pc, nc, c.suma);
+    escribirArreglo(archivo, ci.cy, pc, nc, c.suma);
+    escribirArreglo(archivo, ci.r, pc, nc, c.suma);
+    escribirArreglo(archivo, ci.color, pc, nc, c.suma);
+    escribirArreglo(archivo, ci.grosor, pc, nc, c.suma);
+    escribirArreglo(archivo, ci.relleno, pc, nc, c.suma);
+    escribirArreglo(archivo, el.cx, pe, ne, c.suma);
+    escribirArreglo(archivo, el.cy, pe, ne, c.suma);
+    escribirArreglo(archivo, el.rx, pe, ne, c.suma);
+    escribirArreglo(archivo, el.ry, pe, ne, c.suma);
+    escribirArreglo(archivo, el.color, pe, ne, c.suma);
+    escribirArreglo(archivo, el.grosor, pe, ne, c.suma);
+    escribirArreglo(archivo, el.relleno, pe, ne, c.suma);
+
+    // La suma solo se conoce al final
+    archivo.seekp(0);
+    archivo.write((const char *) &c, sizeof(c));
+    return (bool) archivo;
 }
 
-void dibujarPuntosCirculo(int cx, int cy, int x, int y) {
-    dibujarPunto(cx + x, cy + y);
-    dibujarPunto(cx - x, cy + y);
-    dibujarPunto(cx + x, cy - y);
-    dibujarPunto(cx - x, cy - y);
-    dibujarPunto(cx + y, cy + x);
-    dibujarPunto(cx - y, cy + x);
-    dibujarPunto(cx + y, cy - x);
-    dibujarPunto(cx - y, cy - x);
+// Archivo proyectado en memoria de solo lectura
+struct ArchivoMapeado {
+    const unsigned char *datos;
+    size_t tam;
+#ifdef _WIN32
+    HANDLE archivo, mapeo;
+#endif
+};
+
+bool mapearArchivo(const string &ruta, ArchivoMapeado &m) {
+    m.datos = NULL;
+    m.tam = 0;
+#ifdef _WIN32
+    m.archivo = CreateFileA(ruta.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m.archivo == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER tam;
+    if (!GetFileSizeEx(m.archivo, &tam) || tam.QuadPart == 0) {
+        CloseHandle(m.archivo);
+        return false;
+    }
+    m.tam = (size_t) tam.QuadPart;
+    m.mapeo = CreateFileMappingA(m.archivo, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (m.mapeo == NULL) {
+        CloseHandle(m.archivo);
+        return false;
+    }
+    m.datos = (const unsigned char *) MapViewOfFile(m.mapeo, FILE_MAP_READ, 0, 0, 0);
+    if (m.datos == NULL) {
+        CloseHandle(m.mapeo);
+        CloseHandle(m.archivo);
+        return false;
+    }
+#else
+    int fd = open(ruta.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    m.tam = (size_t) st.st_size;
+    void *p = mmap(NULL, m.tam, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return false;
+    m.datos = (const unsigned char *) p;
+#endif
+    return true;
 }
 
-void dibujarCirculoPuntoMedio(int cx, int cy, int r, int grosor) {
-    int x = 0, y = r;
-    int p = 1 - r;
-    glPointSize(grosor);
-    glBegin(GL_POINTS);
-    dibujarPuntosCirculo(cx, cy, x, y);
-    while (x < y) {
-        x++;
-        if (p < 0) p += 2*x + 1;
-        else {
-            y--;
-            p += 2*(x - y) + 1;
-        }
-        dibujarPuntosCirculo(cx, cy, x, y);
+void liberarMapeo(ArchivoMapeado &m) {
+    if (m.datos == NULL) return;
+#ifdef _WIN32
+    UnmapViewOfFile(m.datos);
+    CloseHandle(m.mapeo);
+    CloseHandle(m.archivo);
+#else
+    munmap((void *) m.datos, m.tam);
+#endif
+    m.datos = NULL;
+}
+
+// Lector secuencial de los arreglos del archivo mapeado
+struct LectorEscena {
+    const unsigned char *datos;
+    size_t posicion, tam;
+};
+
+// Los arreglos se copian del mapeo a los lotes: el almacén crece y se
+// recorta con deshacer, así que no puede quedar apuntando al archivo
+template <class T>
+bool leerArreglo(LectorEscena &lector, vector<T> &v, size_t n) {
+    size_t bytes = n * sizeof(T);
+    if (bytes / sizeof(T) != n || lector.tam - lector.posicion < alinear8(bytes)) return false;
+    const T *p = (const T *) (lector.datos + lector.posicion);
+    v.insert(v.end(), p, p + n);
+    lector.posicion += alinear8(bytes);
+    return true;
+}
+
+// Agrega al final de e las figuras del archivo; si algo no cuadra deja e como estaba
+bool leerArchivoEscena(const string &ruta, EscenaCompacta &e) {
+    ArchivoMapeado m;
+    if (!mapearArchivo(ruta, m)) return false;
+    CabeceraEscena c;
+    bool valida = m.tam >= sizeof(c);
+    if (valida) {
+        memcpy(&c, m.datos, sizeof(c));
+        valida = memcmp(c.magia, MAGIA_ESCENA, sizeof(c.magia)) == 0 && c.version == VERSION_ESCENA &&
+                 c.marcaOrdenBytes == MARCA_ORDEN_BYTES && c.lineas + c.circulos + c.elipses == c.figuras &&
+                 c.figuras < (1ULL << BITS_POSICION_LOTE) &&
+                 sumarBloque(14695981039346656037ULL, m.datos + sizeof(c), m.tam - sizeof(c)) == c.suma;
+    }
+    if (!valida) {
+        liberarMapeo(m);
+        return false;
+    }
+
+    size_t base[3] = {e.lineas.x0.size(), e.circulos.cx.size(), e.elipses.cx.size()};
+    size_t totalAntes = cantidadFiguras(e);
+    LectorEscena lector = {m.datos, sizeof(c), m.tam};
+    LoteLineas &l = e.lineas;
+    LoteCirculos &ci = e.circulos;
+    LoteElipses &el = e.elipses;
+    bool ok = leerArreglo(lector, e.orden, c.figuras) &&
+              leerArreglo(lector, l.x0, c.lineas) && leerArreglo(lector, l.y0, c.lineas) &&
+              leerArreglo(lector, l.x1, c.lineas) && leerArreglo(lector, l.y1, c.lineas) &&
+              leerArreglo(lector, l.color, c.lineas) && leerArreglo(lector, l.grosor, c.lineas) &&
+              leerArreglo(lector, l.herramienta, c.lineas) &&
+              leerArreglo(lector, ci.cx, c.circulos) && leerArreglo(lector, ci.cy, c.circulos) &&
+              leerArreglo(lector, ci.r, c.circulos) && leerArreglo(lector, ci.color, c.circulos) &&
+              leerArreglo(lector, ci.grosor, c.circulos) && leerArreglo(lector, ci.relleno, c.circulos) &&
+              leerArreglo(lector, el.cx, c.elipses) && leerArreglo(lector, el.cy, c.elipses) &&
+              leerArreglo(lector, el.rx, c.elipses) && leerArreglo(lector, el.ry, c.elipses) &&
+              leerArreglo(lector, el.color, c.elipses) && leerArreglo(lector, el.grosor, c.elipses) &&
+              leerArreglo(lector, el.relleno, c.elipses);
+    liberarMapeo(m);
+    // Las posiciones del archivo empiezan en 0 en cada lote
+    size_t cantidadTipo[3] = {(size_t) c.lineas, (size_t) c.circulos, (size_t) c.elipses};
+    for (size_t i = totalAntes; ok && i < e.orden.size(); i++) {
+        TipoFigura t = tipoFigura(e.orden[i]);
+        ok = t <= TIPO_ELIPSE && posicionEnLote(e.orden[i]) < cantidadTipo[t] &&
+             base[t] + cantidadTipo[t] <= (1u << BITS_POSICION_LOTE);
+        if (ok) e.orden[i] += (unsigned int) base[t];
+    }
+    // La suma solo detecta daños accidentales: la herramienta indexa tablas y
+    // elige el algoritmo, así que se comprueba igual que el relleno
+    for (size_t k = base[TIPO_LINEA]; ok && k < l.herramienta.size(); k++)
+        ok = l.herramienta[k] <= HERRAMIENTA_LINEA_DDA_FIJO;
+    for (size_t k = base[TIPO_CIRCULO]; ok && k < ci.relleno.size(); k++) ok = ci.relleno[k] <= 1;
+    for (size_t k = base[TIPO_ELIPSE]; ok && k < el.relleno.size(); k++) ok = el.relleno[k] <= 1;
+    // Con orden sin validar truncarEscena no sirve: se vuelve a los tamaños de antes
+    if (!ok) {
+        e.orden.resize(totalAntes);
+        redimensionarLote(l, base[TIPO_LINEA]);
+        redimensionarLote(ci, base[TIPO_CIRCULO]);
+        redimensionarLote(el, base[TIPO_ELIPSE]);
     }
-    glEnd();
+    return ok;
 }
 
-void dibujarPuntosElipse(int cx, int cy, int x, int y) {
-    dibujarPunto(cx + x, cy + y);
-    dibujarPunto(cx - x, cy + y);
-    dibujarPunto(cx + x, cy - y);
-    dibujarPunto(cx - x, cy - y);
+// Figuras leídas de un archivo que aún no se agregaron al almacén
+EscenaCompacta escenaLeida;
+
+// Dónde leer figuras nuevas sin descartar todavía lo que se puede rehacer:
+// el final del almacén si no hay nada para rehacer, si no escenaLeida
+EscenaCompacta &destinoLectura() {
+    if (cantidadFiguras(figuras) == finEscena) return figuras;
+    truncarEscena(escenaLeida, 0);
+    return escenaLeida;
 }
 
-void dibujarElipsePuntoMedio(int cx, int cy, int rx, int ry, int grosor) {
-    int x = 0, y = ry;
-    long rx2 = rx*rx, ry2 = ry*ry;
-    long dos_rx2 = 2*rx2, dos_ry2 = 2*ry2;
-    double p1 = ry2 - rx2 * ry + 0.25*rx2;
-    glPointSize(grosor);
-    glBegin(GL_POINTS);
-    while (dos_ry2*x <= dos_rx2*y) {
-        dibujarPuntosElipse(cx, cy, x, y);
-        if (p1 < 0) {
-            x++;
-            p1 += dos_ry2*x + ry2;
-        } else {
-            x++;
-            y--;
-            p1 += dos_ry2*x - dos_rx2*y + ry2;
-        }
+// Tras una lectura correcta en destinoLectura(): descarta lo que se podía
+// rehacer y deja las figuras leídas al final del almacén, desde finEscena
+bool confirmarLectura(EscenaCompacta &leida) {
+    if (&leida == &figuras) {
+        historial.resize(posicionHistorial);
+        return true;
     }
-    double p2 = ry2*(x+0.5)*(x+0.5) + rx2*(y-1)*(y-1) - rx2*ry2;
-    while (y >= 0) {
-        dibujarPuntosElipse(cx, cy, x, y);
-        if (p2 > 0) {
-            y--;
-            p2 -= dos_rx2*y + rx2;
-        } else {
-            y--;
-            x++;
-            p2 += dos_ry2*x - dos_rx2*y + rx2;
-        }
+    if (cantidadFiguras(figuras) + cantidadFiguras(leida) > (1u << BITS_POSICION_LOTE)) return false;
+    prepararOperacion();
+    anexarEscena(figuras, leida);
+    leida = EscenaCompacta();
+    return true;
+}
+
+// Deshace una lectura fallida o que no se va a usar
+void descartarLectura(EscenaCompacta &leida, size_t totalAntes) {
+    if (&leida == &figuras) truncarEscena(figuras, totalAntes);
+    else leida = EscenaCompacta();
+}
+
+// Agrega las figuras del archivo al final del almacén y las muestra en lugar
+// de la escena actual, como una operación que se puede deshacer
+bool cargarEscena(const string &ruta) {
+    lock_guard<mutex> bloqueo(candadoEscena);
+    EscenaCompacta &leida = destinoLectura();
+    if (!leerArchivoEscena(ruta, leida)) return false;
+    size_t inicioAntes = inicioEscena, finAntes = finEscena;
+    if (!confirmarLectura(leida)) {
+        descartarLectura(leida, finAntes);
+        return false;
     }
-    glEnd();
+    invalidarIndice();
+    inicioEscena = finAntes;
+    finEscena = cantidadFiguras(figuras);
+    invalidarLienzoPersistente();
+    registrarOperacion(OPERACION_LOTE, inicioAntes, finAntes);
+    return true;
 }
 
-void dibujarFigura(const Figura &f) {
-    glColor3f(f.color.r, f.color.g, f.color.b);
-    switch (f.tipoHerramienta) {
-        case HERRAMIENTA_LINEA_DIRECTA:
-            dibujarLineaDirecta(f.xInicio, f.yInicio, f.xFin, f.yFin, f.grosor);
-            break;
-        case HERRAMIENTA_LINEA_DDA:
-            dibujarLineaDDA(f.xInicio, f.yInicio, f.xFin, f.yFin, f.grosor);
-            break;
-        case HERRAMIENTA_CIRCULO_PUNTO_MEDIO:
-            dibujarCirculoPuntoMedio(f.centroX, f.centroY, f.radio, f.grosor);
-            break;
-        case HERRAMIENTA_ELIPSE_PUNTO_MEDIO:
-            dibujarElipsePuntoMedio(f.centroX, f.centroY, f.radioX, f.radioY, f.grosor);
-            break;
-        default:
-            break;
+// Importación de texto, una figura por línea:
+//   <tipo> <coordenadas> <r> <g> <b> <grosor>
+// con tipo directa, dda, bresenham o ddafijo (x0 y0 x1 y1), circulo o
+// circulorelleno (cx cy radio), elipse o elipserellena (cx cy rx ry) y el
+// color en 0-255. Las líneas vacías y las que empiezan con '#' se ignoran.
+// El archivo se lee por bloques fijos y las figuras se entregan por lotes,
+// así la memoria no depende del tamaño del archivo
+const size_t TAM_BLOQUE_IMPORTACION = 1 << 16;
+const size_t FIGURAS_POR_LOTE_IMPORTACION = 4096;
+
+typedef void (*DestinoImportacion)(const Figura *f, size_t n);
+
+struct ResultadoImportacion {
+    size_t bytes, figuras, errores;
+    double ms;
+};
+
+struct TipoTexto {
+    const char *nombre;
+    Herramienta herramienta;
+    int coordenadas;
+};
+
+const TipoTexto TIPOS_TEXTO[] = {
+    {"directa", HERRAMIENTA_LINEA_DIRECTA, 4},
+    {"dda", HERRAMIENTA_LINEA_DDA, 4},
+    {"bresenham", HERRAMIENTA_LINEA_BRESENHAM, 4},
+    {"ddafijo", HERRAMIENTA_LINEA_DDA_FIJO, 4},
+    {"circulo", HERRAMIENTA_CIRCULO_PUNTO_MEDIO, 3},
+    {"circulorelleno", HERRAMIENTA_CIRCULO_RELLENO, 3},
+    {"elipse", HERRAMIENTA_ELIPSE_PUNTO_MEDIO, 4},
+    {"elipserellena", HERRAMIENTA_ELIPSE_RELLENA, 4},
+};
+
+inline bool esEspacio(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Entero decimal con signo opcional, seguido de espacio o fin de línea
+bool leerEntero(const char *&p, const char *fin, int &valor) {
+    while (p < fin && esEspacio(*p)) p++;
+    bool negativo = false;
+    if (p < fin && (*p == '-' || *p == '+')) negativo = *p++ == '-';
+    if (p == fin || *p < '0' || *p > '9') return false;
+    long long v = 0;
+    while (p < fin && *p >= '0' && *p <= '9') {
+        v = v * 10 + (*p++ - '0');
+        if (v > INT_MAX) return false;
     }
+    valor = (int) (negativo ? -v : v);
+    return p == fin || esEspacio(*p);
 }
 
-void redibujarTodo() {
-    glClear(GL_COLOR_BUFFER_BIT);
+// Interpreta [p, fin) en f; `vacia` indica una línea sin figura que no es error
+bool interpretarLinea(const char *p, const char *fin, Figura &f, bool &vacia) {
+    while (p < fin && esEspacio(*p)) p++;
+    vacia = p == fin || *p == '#';
+    if (vacia) return false;
+    const char *palabra = p;
+    while (p < fin && !esEspacio(*p)) p++;
+    size_t largo = p - palabra;
+    const TipoTexto *tipo = NULL;
+    for (const TipoTexto &t : TIPOS_TEXTO)
+        if (strlen(t.nombre) == largo && memcmp(t.nombre, palabra, largo) == 0) tipo = &t;
+    if (tipo == NULL) return false;
+
+    int v[8];
+    int cantidad = tipo->coordenadas + 4;
+    for (int i = 0; i < cantidad; i++)
+        if (!leerEntero(p, fin, v[i])) return false;
+    while (p < fin && esEspacio(*p)) p++;
+    if (p != fin) return false;
+    const int *c = v + tipo->coordenadas;
+    if (c[0] < 0 || c[0] > 255 || c[1] < 0 || c[1] > 255 || c[2] < 0 || c[2] > 255 || c[3] < 1 || c[3] > 255)
+        return false;
+
+    bool esLinea = tipo->herramienta <= HERRAMIENTA_LINEA_DDA_FIJO;
+    if (!esLinea && (v[2] < 0 || (tipo->coordenadas == 4 && v[3] < 0))) return false;   // radios
+
+    f.tipoHerramienta = tipo->herramienta;
+    f.xInicio = f.centroX = v[0];
+    f.yInicio = f.centroY = v[1];
+    f.xFin = f.radio = f.radioX = v[2];
+    f.yFin = f.radioY = tipo->coordenadas == 4 ? v[3] : v[2];
+    f.color.r = c[0] / 255.f;
+    f.color.g = c[1] / 255.f;
+    f.color.b = c[2] / 255.f;
+    f.grosor = c[3];
+    return true;
+}
 
-    // Dibujar cuadrícula
-    if (mostrarCuadricula) {
-        glColor3f(0.85f, 0.85f, 0.85f);
-        glBegin(GL_LINES);
-        for (int x = 0; x <= anchoViewport; x += 20) {
-            glVertex2i(x, 0);
-            glVertex2i(x, altoViewport);
+bool importarTexto(const string &ruta, DestinoImportacion destino, ResultadoImportacion &r) {
+    r.bytes = r.figuras = r.errores = 0;
+    r.ms = 0;
+    FILE *archivo = fopen(ruta.c_str(), "rb");
+    if (archivo == NULL) return false;
+    auto t0 = chrono::steady_clock::now();
+    vector<char> bloque(TAM_BLOQUE_IMPORTACION);
+    vector<Figura> lote(FIGURAS_POR_LOTE_IMPORTACION);
+    size_t enLote = 0, pendiente = 0, numeroLinea = 0;
+    bool descartando = false;       // resto de una línea más larga que el bloque
+    while (true) {
+        size_t leidos = fread(&bloque[pendiente], 1, bloque.size() - pendiente, archivo);
+        r.bytes += leidos;
+        bool finArchivo = leidos == 0;
+        const char *p = &bloque[0], *finDatos = p + pendiente + leidos;
+        while (p < finDatos) {
+            const char *salto = (const char *) memchr(p, '\n', finDatos - p);
+            if (salto == NULL) {
+                if (!finArchivo) break;
+                salto = finDatos;       // última línea sin salto
+            }
+            if (descartando) {
+                descartando = false;
+            } else {
+                numeroLinea++;
+                bool vacia;
+                if (interpretarLinea(p, salto, lote[enLote], vacia)) {
+                    if (++enLote == lote.size()) {
+                        destino(&lote[0], enLote);
+                        r.figuras += enLote;
+                        enLote = 0;
+                    }
+                } else if (!vacia) {
+                    if (r.errores++ < 10) cerr << ruta << ":" << numeroLinea << ": línea no válida" << endl;
+                }
+            }
+            p = salto + 1;
         }
-        for (int y = 0; y <= altoViewport; y += 20) {
-            glVertex2i(0, y);
-            glVertex2i(anchoViewport, y);
+        if (finArchivo) break;
+        pendiente = p < finDatos ? finDatos - p : 0;
+        if (pendiente == bloque.size()) {
+            if (!descartando) {
+                numeroLinea++;
+                if (r.errores++ < 10) cerr << ruta << ":" << numeroLinea << ": línea demasiado larga" << endl;
+            }
+            descartando = true;
+            pendiente = 0;
+        } else if (pendiente > 0) {
+            memmove(&bloque[0], p, pendiente);
         }
-        glEnd();
     }
+    if (enLote > 0) {
+        destino(&lote[0], enLote);
+        r.figuras += enLote;
+    }
+    fclose(archivo);
+    r.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+    return true;
+}
+
+EscenaCompacta *escenaImportacion = &figuras;
+
+void agregarImportadas(const Figura *f, size_t n) {
+    for (size_t i = 0; i < n; i++) agregarAEscena(*escenaImportacion, f[i]);
+}
 
-    // Dibujar ejes
-    if (mostrarEjes) {
-        glColor3f(0.6f, 0.6f, 0.6f);
-        glBegin(GL_LINES);
-        glVertex2i(0, altoViewport / 2);
-        glVertex2i(anchoViewport, altoViewport / 2);
-        glVertex2i(anchoViewport / 2, 0);
-        glVertex2i(anchoViewport / 2, altoViewport);
-        glEnd();
+// Agrega las figuras del archivo a la escena como una sola operación. Se
+// leen con destinoLectura(), así un archivo que falla o no trae figuras no
+// descarta lo que se podía rehacer
+bool importarAEscena(const string &ruta, ResultadoImportacion &r) {
+    lock_guard<mutex> bloqueo(candadoEscena);
+    EscenaCompacta &leida = destinoLectura();
+    size_t totalAntes = cantidadFiguras(leida);
+    escenaImportacion = &leida;
+    bool ok = importarTexto(ruta, agregarImportadas, r);
+    escenaImportacion = &figuras;
+    if (!ok || cantidadFiguras(leida) == totalAntes) {
+        descartarLectura(leida, totalAntes);
+        return ok;
+    }
+    size_t finAntes = finEscena;
+    if (!confirmarLectura(leida)) {
+        descartarLectura(leida, totalAntes);
+        return false;
     }
+    finEscena = cantidadFiguras(figuras);
+    invalidarIndice();
+    invalidarLienzoPersistente();
+    registrarOperacion(OPERACION_LOTE, inicioEscena, finAntes);
+    return true;
+}
+
+// Lote temporal para rasterizar sin guardar; se reutiliza entre lotes
+thread_local EscenaCompacta loteImportado;
+
+void rasterizarImportadas(const Figura *f, size_t n) {
+    truncarEscena(loteImportado, 0);
+    for (size_t i = 0; i < n; i++) agregarAEscena(loteImportado, f[i]);
+    dibujarFiguras(loteImportado, 0, n);
+}
+
+// Rasteriza el archivo directamente en el lienzo, sin pasar por la escena
+bool renderizarTextoEnLienzo(const string &ruta, Lienzo &lienzo, int ancho, int alto, ResultadoImportacion &r) {
+    lienzo.ancho = ancho;
+    lienzo.alto = alto;
+    lienzo.pixeles.resize((size_t) ancho * alto * 3);
+    dibujarFondoLienzo(lienzo);
+    DestinoPixeles destinoAnterior = destinoPixeles;
+    destinoPixeles = DESTINO_LIENZO;
+    lienzoDestino = &lienzo;
+    bool ok = importarTexto(ruta, rasterizarImportadas, r);
+    lienzoDestino = NULL;
+    destinoPixeles = destinoAnterior;
+    return ok;
+}
+
+void informarImportacion(const string &ruta, const ResultadoImportacion &r) {
+    cout << "Importadas " << r.figuras << " figuras de " << ruta << " (" << r.errores << " errores): "
+         << r.bytes / 1048576.0 << " MB en " << r.ms << " ms, "
+         << (r.ms > 0 ? r.bytes / 1048576.0 / (r.ms / 1000) : 0) << " MB/s" << endl;
+}
+
+// Vuelve a pintar la zona z (en píxeles) desde el fondo, con las figuras
+// que la tocan recortadas a ella
+void repintarZonaLienzo(Lienzo &lienzo, Rectangulo z) {
+    z.x0 = max(z.x0, 0);
+    z.y0 = max(z.y0, 0);
+    z.x1 = min(z.x1, lienzo.ancho - 1);
+    z.y1 = min(z.y1, lienzo.alto - 1);
+    if (z.x0 > z.x1 || z.y0 > z.y1) return;
+    dibujarFondoEnZona(lienzo, z);
+    pixelesTocados += (unsigned long) (z.x1 - z.x0 + 1) * (z.y1 - z.y0 + 1);
+    vector<unsigned int> afectadas;
+    consultarRectangulo(rectanguloEnMundo(transformacionDestino, z), afectadas);
+    recorteLienzo = z;
+    dibujarListaFiguras(figuras, afectadas);
+    recorteLienzo.x0 = recorteLienzo.y0 = INT_MIN;
+    recorteLienzo.x1 = recorteLienzo.y1 = INT_MAX;
+}
 
-    for (auto &fig : figuras) {
-        dibujarFigura(fig);
+// Aplica al lienzo persistente solo los cambios ocurridos desde el último
+// frame. El lienzo muestra la vista: mover o acercar la vista lo invalida
+void actualizarLienzoPersistente() {
+    Lienzo &l = lienzoPersistente;
+    pixelesTocados = 0;
+    if (l.ancho != anchoViewport || l.alto != altoViewport) {
+        l.ancho = anchoViewport;
+        l.alto = altoViewport;
+        l.pixeles.resize((size_t) l.ancho * l.alto * 3);
+        invalidarLienzoPersistente();
     }
-    glutSwapBuffers();
+    DestinoPixeles destinoAnterior = destinoPixeles;
+    TransformacionVista transformacionAnterior = transformacionDestino;
+    destinoPixeles = DESTINO_LIENZO;
+    transformacionDestino = transformacionVista;
+    lienzoDestino = &l;
+    if (lienzoPersistenteInvalido) {
+        Rectangulo todo = {0, 0, l.ancho - 1, l.alto - 1};
+        repintarZonaLienzo(l, todo);
+        lienzoPersistenteInvalido = false;
+    } else {
+        for (auto &c : cambiosLienzo) {
+            if (c.esZona) repintarZonaLienzo(l, rectanguloEnPantalla(transformacionDestino, c.zona));
+            else if (c.figura >= inicioEscena && c.figura < finEscena)
+                dibujarFiguras(figuras, c.figura, c.figura + 1);
+        }
+    }
+    cambiosLienzo.clear();
+    lienzoDestino = NULL;
+    transformacionDestino = transformacionAnterior;
+    destinoPixeles = destinoAnterior;
 }
 
+// Grabación de sesiones: cada llamada a cambiarTamanoVista, raton,
+// moverRaton, moverRatonLibre y manejarMenu se guarda como una línea de
+// texto, con los milisegundos desde el inicio de la grabación:
+//   <ms> ventana <ancho> <alto>
+//   <ms> raton <boton> <estado> <x> <y>
+//   <ms> arrastre <x> <y>
+//   <ms> movimiento <x> <y>
+//   <ms> menu <opcion>
+FILE *grabacionSesion = NULL;
+chrono::steady_clock::time_point inicioGrabacion;
 
-void mostrar() {
-    redibujarTodo();
+void terminarGrabacion() {
+    if (grabacionSesion == NULL) return;
+    fclose(grabacionSesion);
+    grabacionSesion = NULL;
 }
 
-void reajustar(int w, int h) {
+bool empezarGrabacion(const string &ruta) {
+    terminarGrabacion();
+    grabacionSesion = fopen(ruta.c_str(), "w");
+    if (grabacionSesion == NULL) return false;
+    inicioGrabacion = chrono::steady_clock::now();
+    fputs("# sesion DMV 1\n", grabacionSesion);
+    // Las coordenadas del ratón dependen del alto de la ventana
+    fprintf(grabacionSesion, "0 ventana %d %d\n", anchoViewport, altoViewport);
+    return true;
+}
+
+void cambiarTamanoVista(int w, int h) {
+    if (grabacionSesion != NULL) fprintf(grabacionSesion, "%.3f ventana %d %d\n", msDesde(inicioGrabacion), w, h);
+    capturaEscenaValida = false;
     anchoViewport = w;
     altoViewport = h;
-    glViewport(0, 0, w, h);
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    gluOrtho2D(0, w, 0, h);
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
+    invalidarFondo();
+}
+
+// Tras mover o acercar la vista cambian el fondo y todo el lienzo
+// persistente; la caché de vértices lo comprueba al dibujar
+void vistaCambiada() {
+    capturaEscenaValida = false;
+    invalidarFondo();
+    invalidarLienzoPersistente();
+    glutPostRedisplay();
+}
+
+// Cambia el nivel de zoom dejando quieto el punto del mundo bajo el píxel (px, py)
+void cambiarZoom(int pasos, int px, int py) {
+    int nivel = max(NIVEL_ZOOM_MINIMO, min(NIVEL_ZOOM_MAXIMO, nivelZoom + pasos));
+    if (nivel == nivelZoom) return;
+    TransformacionVista &t = transformacionVista;
+    double mx = (px + t.desplazamientoX) / t.escala, my = (py + t.desplazamientoY) / t.escala;
+    nivelZoom = nivel;
+    t.escala = pow(FACTOR_ZOOM, nivel);
+    t.desplazamientoX = acotarCoordenada(mx * t.escala - px);
+    t.desplazamientoY = acotarCoordenada(my * t.escala - py);
+    vistaCambiada();
+}
+
+void desplazarVista(int dx, int dy) {
+    if (dx == 0 && dy == 0) return;
+    transformacionVista.desplazamientoX += dx;
+    transformacionVista.desplazamientoY += dy;
+    vistaCambiada();
+}
+
+void restablecerVista() {
+    transformacionVista = VISTA_IDENTIDAD;
+    nivelZoom = 0;
+    vistaCambiada();
+}
+
+// Arrastre con un botón pulsado; solo el central mueve la vista
+void moverRaton(int x, int y) {
+    if (grabacionSesion != NULL) fprintf(grabacionSesion, "%.3f arrastre %d %d\n", msDesde(inicioGrabacion), x, y);
+    previaX = x;
+    previaY = altoViewport - y;
+    if (!arrastrandoVista) {
+        if (esperandoSegundoClick) glutPostRedisplay();
+        return;
+    }
+    // El dibujo sigue al ratón; en GLUT la y crece hacia abajo
+    desplazarVista(arrastreX - x, y - arrastreY);
+    arrastreX = x;
+    arrastreY = y;
 }
 
 void raton(int boton, int estado, int x, int y) {
-    int ox = x;
-    int oy = altoViewport - y;
+    if (grabacionSesion != NULL)
+        fprintf(grabacionSesion, "%.3f raton %d %d %d %d\n", msDesde(inicioGrabacion), boton, estado, x, y);
+    capturaEscenaValida = false;
+    if (boton == BOTON_RUEDA_ARRIBA || boton == BOTON_RUEDA_ABAJO) {
+        if (estado == GLUT_DOWN) cambiarZoom(boton == BOTON_RUEDA_ARRIBA ? 1 : -1, x, altoViewport - y);
+        return;
+    }
+    if (boton == GLUT_MIDDLE_BUTTON) {
+        arrastrandoVista = estado == GLUT_DOWN;
+        arrastreX = x;
+        arrastreY = y;
+        return;
+    }
+    // Las figuras se guardan en coordenadas del mundo
+    int ox = mundoX(transformacionVista, x);
+    int oy = mundoY(transformacionVista, altoViewport - y);
     if (boton == GLUT_LEFT_BUTTON && estado == GLUT_DOWN) {
         if (!esperandoSegundoClick) {
             primerX = ox;
             primerY = oy;
+            previaX = x;
+            previaY = altoViewport - y;
             esperandoSegundoClick = true;
+            glutPostRedisplay();
         } else {
-            guardarParaDeshacer();
-            Figura f;
-            f.color = colorActual;
-            f.grosor = grosorActual;
-            switch (herramientaActual) {
-                case HERRAMIENTA_LINEA_DIRECTA:
-                case HERRAMIENTA_LINEA_DDA:
-                    f.tipoHerramienta = herramientaActual;
-                    f.xInicio = primerX;
-                    f.yInicio = primerY;
-                    f.xFin = ox;
-                    f.yFin = oy;
-                    break;
-                case HERRAMIENTA_CIRCULO_PUNTO_MEDIO:
-                    f.tipoHerramienta = HERRAMIENTA_CIRCULO_PUNTO_MEDIO;
-                    f.centroX = primerX;
-                    f.centroY = primerY;
-                    f.radio = round(sqrt(pow(ox - primerX, 2) + pow(oy - primerY, 2)));
-                    break;
-                case HERRAMIENTA_ELIPSE_PUNTO_MEDIO:
-                    f.tipoHerramienta = HERRAMIENTA_ELIPSE_PUNTO_MEDIO;
-                    f.centroX = primerX;
-                    f.centroY = primerY;
-                    f.radioX = abs(ox - primerX);
-                    f.radioY = abs(oy - primerY);
-                    break;
-                default:
-                    break;
-            }
-            figuras.push_back(f);
+            agregarFigura(figuraEntrePuntos(ox, oy));
             esperandoSegundoClick = false;
             glutPostRedisplay();
         }
     }
 }
 
+// Sin botones pulsados el ratón solo mueve la vista previa. GLUT junta los
+// glutPostRedisplay pendientes, así que por muchos movimientos que lleguen
+// entre dos cuadros se dibuja uno, con la última posición
+void moverRatonLibre(int x, int y) {
+    if (grabacionSesion != NULL) fprintf(grabacionSesion, "%.3f movimiento %d %d\n", msDesde(inicioGrabacion), x, y);
+    previaX = x;
+    previaY = altoViewport - y;
+    if (esperandoSegundoClick) glutPostRedisplay();
+}
+
 void manejarMenu(int opcion) {
+    if (grabacionSesion != NULL) fprintf(grabacionSesion, "%.3f menu %d\n", msDesde(inicioGrabacion), opcion);
+    capturaEscenaValida = false;
     switch (opcion) {
         case 1: herramientaActual = HERRAMIENTA_LINEA_DIRECTA; break;
         case 2: herramientaActual = HERRAMIENTA_LINEA_DDA; break;
         case 3: herramientaActual = HERRAMIENTA_CIRCULO_PUNTO_MEDIO; break;
         case 4: herramientaActual = HERRAMIENTA_ELIPSE_PUNTO_MEDIO; break;
+        case 5: herramientaActual = HERRAMIENTA_LINEA_BRESENHAM; break;
+        case 6: herramientaActual = HERRAMIENTA_LINEA_DDA_FIJO; break;
+        case 7: herramientaActual = HERRAMIENTA_CIRCULO_RELLENO; break;
+        case 8: herramientaActual = HERRAMIENTA_ELIPSE_RELLENA; break;
         case 10: colorActual = {0.f, 0.f, 0.f}; break;      // Negro
         case 11: colorActual = {1.f, 0.f, 0.f}; break;      // Rojo
         case 12: colorActual = {0.f, 1.f, 0.f}; break;      // Verde
@@ -318,22 +3123,179 @@ void manejarMenu(int opcion) {
         case 21: grosorActual = 2; break;
         case 22: grosorActual = 3; break;
         case 23: grosorActual = 5; break;
-        case 30: mostrarCuadricula = !mostrarCuadricula; break;
-        case 31: mostrarEjes = !mostrarEjes; break;
-        case 40: guardarParaDeshacer(); figuras.clear(); break;
+        case 30: mostrarCuadricula = !mostrarCuadricula; invalidarFondo(); invalidarLienzoPersistente(); break;
+        case 31: mostrarEjes = !mostrarEjes; invalidarFondo(); invalidarLienzoPersistente(); break;
+        case 32:
+            usarLienzoPersistente = !usarLienzoPersistente;
+            invalidarLienzoPersistente();
+            if (!usarLienzoPersistente) glutSetWindowTitle("Proyecto de unidad - DMV");
+            break;
+        case 33: mostrarEstadisticas = !mostrarEstadisticas; actualizarMedirCuadros(); break;
+        case 34:
+            if (registroCuadros != NULL) cerrarRegistroCuadros();
+            else if (abrirRegistroCuadros(rutaRegistroCuadros)) cout << "Registrando cuadros en " << rutaRegistroCuadros << endl;
+            else cerr << "No se pudo escribir " << rutaRegistroCuadros << endl;
+            break;
+        case 35: restablecerVista(); break;
+        case 40: limpiarEscena(); break;
         case 41: deshacer(); break;
         case 42: rehacer(); break;
+        case 43:
+        case 46:
+        case 47: {
+            FormatoImagen formato = opcion == 46 ? FORMATO_QOI : opcion == 47 ? FORMATO_PNG : FORMATO_PPM;
+            exportarEscena(string("dibujo") + extensionFormato(formato), formato);
+            if (!progresoExportacionVisible) mostrarProgresoExportacion(0);
+            break;
+        }
+        case 44:
+            if (guardarEscena(rutaEscena)) cout << "Escena guardada en " << rutaEscena << endl;
+            else cerr << "No se pudo escribir " << rutaEscena << endl;
+            break;
+        case 45:
+            if (cargarEscena(rutaEscena)) cout << "Escena cargada de " << rutaEscena << endl;
+            else cerr << "No se pudo cargar " << rutaEscena << endl;
+            break;
 
     }
     glutPostRedisplay();
 }
 
+struct EventoSesion {
+    double ms;
+    char tipo;          // 'v' ventana, 'r' raton, 'a' arrastre, 'p' movimiento, 'm' menu
+    int a, b, c, d;
+};
+
+bool leerSesion(const string &ruta, vector<EventoSesion> &eventos) {
+    FILE *archivo = fopen(ruta.c_str(), "r");
+    if (archivo == NULL) return false;
+    char linea[256], tipo[16];
+    size_t numeroLinea = 0;
+    bool ok = true;
+    while (ok && fgets(linea, sizeof(linea), archivo)) {
+        numeroLinea++;
+        if (linea[0] == '#' || linea[0] == '\n' || linea[0] == '\r') continue;
+        EventoSesion e = {0, 0, 0, 0, 0, 0};
+        int leidos = sscanf(linea, "%lf %15s %d %d %d %d", &e.ms, tipo, &e.a, &e.b, &e.c, &e.d);
+        if (leidos == 4 && strcmp(tipo, "ventana") == 0) e.tipo = 'v';
+        else if (leidos == 4 && strcmp(tipo, "arrastre") == 0) e.tipo = 'a';
+        else if (leidos == 4 && strcmp(tipo, "movimiento") == 0) e.tipo = 'p';
+        else if (leidos == 6 && strcmp(tipo, "raton") == 0) e.tipo = 'r';
+        else if (leidos == 3 && strcmp(tipo, "menu") == 0) e.tipo = 'm';
+        else {
+            cerr << ruta << ":" << numeroLinea << ": evento no válido" << endl;
+            ok = false;
+        }
+        eventos.push_back(e);
+    }
+    fclose(archivo);
+    return ok;
+}
+
+void aplicarEvento(const EventoSesion &e) {
+    switch (e.tipo) {
+        case 'v': cambiarTamanoVista(e.a, e.b); break;
+        case 'r': raton(e.a, e.b, e.c, e.d); break;
+        case 'a': moverRaton(e.a, e.b); break;
+        case 'p': moverRatonLibre(e.a, e.b); break;
+        case 'm': manejarMenu(e.a); break;
+    }
+}
+
+chrono::steady_clock::time_point inicioReproduccion;
+
+void empezarReproduccion() {
+    reproduciendoSesion = true;
+    resumenCuadros = ResumenCuadros();
+    actualizarMedirCuadros();
+    inicioReproduccion = chrono::steady_clock::now();
+}
+
+void terminarReproduccion(const string &ruta, size_t eventos) {
+    double ms = msDesde(inicioReproduccion);
+    reproduciendoSesion = false;
+    actualizarMedirCuadros();
+    const ResumenCuadros &r = resumenCuadros;
+    size_t bytesCache = cacheVertices.vertices.capacity() * sizeof(GLint) + cacheVertices.colores.capacity() +
+                        cacheVertices.inicioFigura.capacity() * sizeof(size_t);
+    cout << "Sesión " << ruta << ": " << eventos << " eventos, " << r.cuadros << " cuadros en " << ms << " ms; cuadro medio "
+         << (r.cuadros ? r.msTotal / r.cuadros : 0) << " ms, máximo " << r.msMaximo << " ms; "
+         << finEscena - inicioEscena << " figuras, escena " << memoriaEscena(figuras) / 1048576.0
+         << " MB, caché de vértices " << bytesCache / 1048576.0 << " MB" << endl;
+}
+
+// Sin ventana cada evento va seguido de un cuadro del lienzo persistente,
+// como con "Lienzo persistente (CPU)" activado; entre los dos clics se
+// compone además la vista previa sobre una copia
+bool reproducirSinVentana(const string &ruta, bool tiempoOriginal) {
+    vector<EventoSesion> eventos;
+    if (!leerSesion(ruta, eventos)) return false;
+    empezarReproduccion();
+    for (const EventoSesion &e : eventos) {
+        if (tiempoOriginal)
+            this_thread::sleep_until(inicioReproduccion + chrono::microseconds((long long) (e.ms * 1000)));
+        aplicarEvento(e);
+        empezarCuadro();
+        actualizarLienzoPersistente();
+        if (esperandoSegundoClick) componerVistaPrevia(lienzoVistaPrevia);
+        size_t dibujadas = 0;
+        for (int h = 0; h < HERRAMIENTA_NINGUNA; h++) dibujadas += medicionHerramientas[h].figuras;
+        terminarCuadro(dibujadas, pixelesTocados);
+    }
+    terminarReproduccion(ruta, eventos.size());
+    return true;
+}
+
+#ifndef SIN_VENTANA
+void presentarLienzoPersistente() {
+    if (medirCuadros) empezarCuadro();
+    actualizarLienzoPersistente();
+    glRasterPos2i(0, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glDrawPixels(lienzoPersistente.ancho, lienzoPersistente.alto, GL_RGB, GL_UNSIGNED_BYTE,
+                 &lienzoPersistente.pixeles[0]);
+    dibujarVistaPrevia();
+    if (medirCuadros) {
+        size_t dibujadas = 0;
+        for (int h = 0; h < HERRAMIENTA_NINGUNA; h++) dibujadas += medicionHerramientas[h].figuras;
+        terminarCuadro(dibujadas, pixelesTocados);
+    }
+    if (mostrarEstadisticas) dibujarEstadisticas(ultimoCuadro);
+    glutSwapBuffers();
+
+    if (progresoExportacionVisible) return;
+    char titulo[96];
+    snprintf(titulo, sizeof(titulo), "Proyecto de unidad - DMV (%lu px tocados)", pixelesTocados);
+    glutSetWindowTitle(titulo);
+}
+
+void mostrar() {
+    if (usarLienzoPersistente) presentarLienzoPersistente();
+    else if (esperandoSegundoClick && capturaEscenaValida) presentarVistaPrevia();
+    else redibujarTodo();
+}
+
+void reajustar(int w, int h) {
+    cambiarTamanoVista(w, h);
+    glViewport(0, 0, w, h);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    gluOrtho2D(0, w, 0, h);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+}
+
 void crearMenus() {
     int menuDibujo = glutCreateMenu(manejarMenu);
     glutAddMenuEntry("Línea Directa", 1);
     glutAddMenuEntry("Línea DDA", 2);
+    glutAddMenuEntry("Línea Bresenham", 5);
+    glutAddMenuEntry("Línea DDA punto fijo", 6);
     glutAddMenuEntry("Círculo PM", 3);
     glutAddMenuEntry("Elipse PM", 4);
+    glutAddMenuEntry("Círculo relleno", 7);
+    glutAddMenuEntry("Elipse rellena", 8);
 
     int menuColor = glutCreateMenu(manejarMenu);
     glutAddMenuEntry("Negro", 10);
@@ -350,12 +3312,20 @@ void crearMenus() {
     int menuVista = glutCreateMenu(manejarMenu);
     glutAddMenuEntry("Mostrar/Ocultar Cuadrícula", 30);
     glutAddMenuEntry("Mostrar/Ocultar Ejes", 31);
+    glutAddMenuEntry("Lienzo persistente (CPU)", 32);
+    glutAddMenuEntry("Mostrar/Ocultar Estadísticas", 33);
+    glutAddMenuEntry("Registro de cuadros (CSV)", 34);
+    glutAddMenuEntry("Restablecer zoom", 35);
 
     int menuHerramientas = glutCreateMenu(manejarMenu);
     glutAddMenuEntry("Limpiar", 40);
     glutAddMenuEntry("Deshacer", 41);
     glutAddMenuEntry("Rehacer", 42);
     glutAddMenuEntry("Exportar PPM", 43);
+    glutAddMenuEntry("Exportar QOI", 46);
+    glutAddMenuEntry("Exportar PNG", 47);
+    glutAddMenuEntry("Guardar escena", 44);
+    glutAddMenuEntry("Abrir escena", 45);
 
     int menuPrincipal = glutCreateMenu(manejarMenu);
     glutAddSubMenu("Dibujo", menuDibujo);
@@ -367,6 +3337,30 @@ void crearMenus() {
     glutAttachMenu(GLUT_RIGHT_BUTTON);
 }
 
+// Reproducción con ventana: un evento por temporizador, de modo que cada
+// uno va seguido de su cuadro
+vector<EventoSesion> eventosReproduccion;
+size_t siguienteEvento = 0;
+string rutaReproduccion;
+bool reproducirConTiempoOriginal = false;
+bool salirAlTerminarReproduccion = false;
+
+void reproducirSiguienteEvento(int) {
+    if (siguienteEvento >= eventosReproduccion.size()) {
+        terminarReproduccion(rutaReproduccion, eventosReproduccion.size());
+        if (salirAlTerminarReproduccion) exit(0);
+        return;
+    }
+    const EventoSesion &e = eventosReproduccion[siguienteEvento++];
+    if (e.tipo == 'v') glutReshapeWindow(e.a, e.b);
+    aplicarEvento(e);
+    glutPostRedisplay();
+    unsigned int espera = 0;
+    if (reproducirConTiempoOriginal && siguienteEvento < eventosReproduccion.size())
+        espera = (unsigned int) max(0.0, eventosReproduccion[siguienteEvento].ms - msDesde(inicioReproduccion));
+    glutTimerFunc(espera, reproducirSiguienteEvento, 0);
+}
+
 void inicializarGL() {
     glClearColor(1.f, 1.f, 1.f, 1.f);
     glPointSize(1);
@@ -374,9 +3368,228 @@ void inicializarGL() {
     glLoadIdentity();
     gluOrtho2D(0, ANCHO_VENTANA, 0, ALTO_VENTANA);
 }
+#endif
+
+// Escena aleatoria reproducible para las mediciones
+void generarEscenaPrueba(int cantidad, int ancho, int alto) {
+    const Herramienta herramientas[] = {HERRAMIENTA_LINEA_DDA, HERRAMIENTA_LINEA_BRESENHAM,
+                                        HERRAMIENTA_CIRCULO_PUNTO_MEDIO, HERRAMIENTA_ELIPSE_PUNTO_MEDIO};
+    const int grosores[] = {1, 2, 3, 5};
+    srand(1);
+    vector<Figura> lote(cantidad);
+    for (auto &f : lote) {
+        f.tipoHerramienta = herramientas[rand() % 4];
+        f.color.r = rand() % 2;
+        f.color.g = rand() % 2;
+        f.color.b = rand() % 2;
+        f.grosor = grosores[rand() % 4];
+        f.xInicio = f.centroX = rand() % ancho;
+        f.yInicio = f.centroY = rand() % alto;
+        f.xFin = rand() % ancho;
+        f.yFin = rand() % alto;
+        f.radio = 1 + rand() % 100;
+        f.radioX = 1 + rand() % 150;
+        f.radioY = 1 + rand() % 100;
+    }
+    agregarLoteFiguras(&lote[0], lote.size());
+}
 
+// Compara el renderizado por teselas con 1..N hilos contra renderizarEnLienzo
+void medirEscaladoHilos() {
+    const int ancho = 1920, alto = 1080;
+    const int repeticiones = 3;
+    generarEscenaPrueba(20000, ancho, alto);
+    Lienzo referencia, lienzo;
+    // Se toma el mejor de varios intentos para quitar ruido del sistema
+    double base = 1e30;
+    for (int r = 0; r < repeticiones; r++) {
+        auto t0 = chrono::steady_clock::now();
+        renderizarEnLienzo(referencia, ancho, alto);
+        base = min(base, chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count());
+    }
+    cout << "hilos\tms\taceleracion\tidentico" << endl;
+    cout << "serie\t" << base << "\t1\t-" << endl;
+    int maximo = max(4, hilosDisponibles());
+    for (int h = 1; h <= maximo; h *= 2) {
+        double ms = 1e30;
+        for (int r = 0; r < repeticiones; r++) {
+            auto t0 = chrono::steady_clock::now();
+            renderizarEnLienzoParalelo(lienzo, ancho, alto, h);
+            ms = min(ms, chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count());
+        }
+        cout << h << "\t" << ms << "\t" << base / ms << "\t"
+             << (lienzo.pixeles == referencia.pixeles ? "si" : "no") << endl;
+    }
+}
+
+// Fragmentos escritos y tiempo con el sellado de glPointSize frente a los tramos
+void medirTrazos() {
+    const int ancho = 1920, alto = 1080;
+    generarEscenaPrueba(20000, ancho, alto);
+    cout << "trazo\tfragmentos\tms" << endl;
+    for (int modo = 0; modo < 2; modo++) {
+        trazosPorTramos = modo == 1;
+        Lienzo lienzo;
+        pixelesTocados = 0;
+        auto t0 = chrono::steady_clock::now();
+        renderizarEnLienzo(lienzo, ancho, alto);
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+        cout << (trazosPorTramos ? "tramos" : "sellos") << "\t" << pixelesTocados << "\t" << ms << endl;
+    }
+}
+
+// Guarda y vuelve a abrir una escena de 10 millones de figuras
+void medirArchivoEscena() {
+    const string ruta = "medicion.dmv";
+    generarEscenaPrueba(10000000, 1920, 1080);
+    auto t0 = chrono::steady_clock::now();
+    bool guardada = guardarEscena(ruta);
+    double msGuardar = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+    // Se carga sobre un almacén vacío, como al abrir la escena desde main
+    figuras = EscenaCompacta();
+    inicioEscena = finEscena = 0;
+    historial.clear();
+    posicionHistorial = 0;
+    invalidarIndice();
+    t0 = chrono::steady_clock::now();
+    bool cargada = guardada && cargarEscena(ruta);
+    double msCargar = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+    cout << "figuras\tguardar_ms\tcargar_ms\tcorrecto" << endl;
+    cout << finEscena - inicioEscena << "\t" << msGuardar << "\t" << msCargar << "\t"
+         << (cargada ? "si" : "no") << endl;
+    remove(ruta.c_str());
+}
+
+void descartarImportadas(const Figura *, size_t) {
+}
+
+// Genera un archivo de texto de unos 100 MB y lo importa rasterizando
+// directamente y guardando en la escena
+void medirImportacion() {
+    const string ruta = "medicion.txt";
+    const int ancho = 1920, alto = 1080;
+    FILE *archivo = fopen(ruta.c_str(), "wb");
+    if (archivo == NULL) return;
+    srand(1);
+    for (int i = 0; i < 3000000; i++) {
+        int x = rand() % ancho, y = rand() % alto;
+        int r = rand() % 256, g = rand() % 256, b = rand() % 256, grosor = 1 + rand() % 3;
+        switch (i % 4) {
+            case 0: fprintf(archivo, "bresenham %d %d %d %d %d %d %d %d\n", x, y, x + rand() % 41 - 20,
+                            y + rand() % 41 - 20, r, g, b, grosor); break;
+            case 1: fprintf(archivo, "dda %d %d %d %d %d %d %d %d\n", x, y, x + rand() % 41 - 20,
+                            y + rand() % 41 - 20, r, g, b, grosor); break;
+            case 2: fprintf(archivo, "circulo %d %d %d %d %d %d %d\n", x, y, rand() % 20, r, g, b, grosor); break;
+            default: fprintf(archivo, "elipse %d %d %d %d %d %d %d %d\n", x, y, rand() % 30, rand() % 20,
+                             r, g, b, grosor); break;
+        }
+    }
+    fclose(archivo);
+
+    ResultadoImportacion r;
+    if (importarTexto(ruta, descartarImportadas, r)) informarImportacion(ruta + " (solo lectura)", r);
+    Lienzo lienzo;
+    if (renderizarTextoEnLienzo(ruta, lienzo, ancho, alto, r)) informarImportacion(ruta + " -> lienzo", r);
+    if (importarAEscena(ruta, r)) informarImportacion(ruta + " -> escena", r);
+    remove(ruta.c_str());
+}
+
+// Tamaño y velocidad de cada formato sobre escenas de prueba con fondo,
+// cuadrícula y ejes, desde un dibujo casi vacío hasta uno muy cargado
+void medirExportacion() {
+    const int tamanos[2][2] = {{800, 600}, {1920, 1080}};
+    const int cantidades[] = {20, 200, 2000, 20000};
+    const FormatoImagen formatos[] = {FORMATO_PPM, FORMATO_QOI, FORMATO_PNG};
+    const int repeticiones = 3;
+    cout << "ancho\talto\tfiguras\tformato\tbytes\trelacion\tms\tMB/s" << endl;
+    for (auto &tam : tamanos) {
+        for (int cantidad : cantidades) {
+            limpiarEscena();
+            generarEscenaPrueba(cantidad, tam[0], tam[1]);
+            Lienzo lienzo;
+            renderizarEnLienzoParalelo(lienzo, tam[0], tam[1], hilosDisponibles());
+            double mb = lienzo.pixeles.size() / 1048576.0;
+            long bytesPPM = 0;
+            for (FormatoImagen formato : formatos) {
+                string ruta = string("medicion") + extensionFormato(formato);
+                double ms = 1e30;
+                for (int k = 0; k < repeticiones; k++) {
+                    auto t0 = chrono::steady_clock::now();
+                    exportarImagen(lienzo, ruta, formato);
+                    ms = min(ms, msDesde(t0));
+                }
+                long bytes = tamanoArchivo(ruta);
+                if (formato == FORMATO_PPM) bytesPPM = bytes;
+                cout << tam[0] << "\t" << tam[1] << "\t" << cantidad << "\t" << extensionFormato(formato) + 1
+                     << "\t" << bytes << "\t" << (bytes > 0 ? (double) bytesPPM / bytes : 0) << "\t" << ms
+                     << "\t" << (ms > 0 ? mb / (ms / 1000) : 0) << endl;
+                remove(ruta.c_str());
+            }
+        }
+    }
+}
+
+#ifndef SIN_VENTANA
 int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--medir-hilos") == 0) {
+            medirEscaladoHilos();
+            return 0;
+        }
+        if (strcmp(argv[i], "--medir-trazos") == 0) {
+            medirTrazos();
+            return 0;
+        }
+        if (strcmp(argv[i], "--medir-archivo") == 0) {
+            medirArchivoEscena();
+            return 0;
+        }
+        if (strcmp(argv[i], "--medir-importacion") == 0) {
+            medirImportacion();
+            return 0;
+        }
+        if (strcmp(argv[i], "--medir-exportacion") == 0) {
+            medirExportacion();
+            return 0;
+        }
+    }
     glutInit(&argc, argv);
+    // Un argumento que no es opción es la ruta de la escena a abrir
+    bool abrirEscena = false, registrarCuadros = false;
+    const char *rutaImportacion = NULL, *rutaGrabacion = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--limite-historial-mb") == 0 && i + 1 < argc) {
+            limiteMemoriaHistorial = (size_t) atol(argv[++i]) << 20;
+        } else if (strcmp(argv[i], "--importar") == 0 && i + 1 < argc) {
+            rutaImportacion = argv[++i];
+        } else if (strcmp(argv[i], "--grabar") == 0 && i + 1 < argc) {
+            rutaGrabacion = argv[++i];
+        } else if (strcmp(argv[i], "--reproducir") == 0 && i + 1 < argc) {
+            rutaReproduccion = argv[++i];
+        } else if (strcmp(argv[i], "--tiempo-original") == 0) {
+            reproducirConTiempoOriginal = true;
+        } else if (strcmp(argv[i], "--salir") == 0) {
+            salirAlTerminarReproduccion = true;
+        } else if (strcmp(argv[i], "--estadisticas") == 0) {
+            mostrarEstadisticas = true;
+        } else if (strcmp(argv[i], "--registro-cuadros") == 0 && i + 1 < argc) {
+            rutaRegistroCuadros = argv[++i];
+            registrarCuadros = true;
+        } else if (argv[i][0] != '-') {
+            rutaEscena = argv[i];
+            abrirEscena = true;
+        }
+    }
+    if (registrarCuadros && !abrirRegistroCuadros(rutaRegistroCuadros))
+        cerr << "No se pudo escribir " << rutaRegistroCuadros << endl;
+    actualizarMedirCuadros();
+    atexit(cerrarRegistroCuadros);
+    if (abrirEscena && !cargarEscena(rutaEscena)) cerr << "No se pudo cargar " << rutaEscena << endl;
+    if (rutaImportacion != NULL) {
+        ResultadoImportacion r;
+        if (importarAEscena(rutaImportacion, r)) informarImportacion(rutaImportacion, r);
+        else cerr << "No se pudo abrir " << rutaImportacion << endl;
+    }
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
     glutInitWindowSize(ANCHO_VENTANA, ALTO_VENTANA);
     glutCreateWindow("Proyecto de unidad - DMV");
@@ -385,8 +3598,186 @@ int main(int argc, char** argv) {
     glutDisplayFunc(mostrar);
     glutReshapeFunc(reajustar);
     glutMouseFunc(raton);
+    glutMotionFunc(moverRaton);
+    glutPassiveMotionFunc(moverRatonLibre);
+    if (rutaGrabacion != NULL) {
+        if (empezarGrabacion(rutaGrabacion)) atexit(terminarGrabacion);
+        else cerr << "No se pudo escribir " << rutaGrabacion << endl;
+    }
+    if (!rutaReproduccion.empty()) {
+        if (leerSesion(rutaReproduccion, eventosReproduccion)) {
+            empezarReproduccion();
+            glutTimerFunc(0, reproducirSiguienteEvento, 0);
+        } else {
+            cerr << "No se pudo reproducir " << rutaReproduccion << endl;
+        }
+    }
     glutMainLoop();
     return 0;
 }
+#else
+// Renderizador por lotes: mismas rutinas dibujar* que la aplicación, pero
+// sin ventana. Cada archivo de escena (.dmv) o de texto (.txt) se rasteriza
+// en un Lienzo propio y se escribe como <salida>/<nombre>.ppm (o .qoi, .png)
+
+bool terminaEn(const string &s, const char *sufijo) {
+    size_t n = strlen(sufijo);
+    return s.size() >= n && s.compare(s.size() - n, n, sufijo) == 0;
+}
+
+bool esArchivoDeEscena(const string &ruta) {
+    return terminaEn(ruta, ".dmv") || terminaEn(ruta, ".txt");
+}
+
+// Agrega a `rutas` los archivos de escena del directorio, en orden alfabético.
+// Devuelve false si `ruta` no es un directorio
+bool listarDirectorio(const string &ruta, vector<string> &rutas) {
+    vector<string> encontradas;
+#ifdef _WIN32
+    WIN32_FIND_DATAA datos;
+    HANDLE h = FindFirstFileA((ruta + "\\*").c_str(), &datos);
+    if (h == INVALID_HANDLE_VALUE) return false;
+    do {
+        if (!(datos.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && esArchivoDeEscena(datos.cFileName))
+            encontradas.push_back(ruta + "\\" + datos.cFileName);
+    } while (FindNextFileA(h, &datos));
+    FindClose(h);
+#else
+    DIR *d = opendir(ruta.c_str());
+    if (d == NULL) return false;
+    while (dirent *entrada = readdir(d)) {
+        string nombre = entrada->d_name;
+        struct stat st;
+        string completa = ruta + "/" + nombre;
+        if (esArchivoDeEscena(nombre) && stat(completa.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+            encontradas.push_back(completa);
+    }
+    closedir(d);
+#endif
+    sort(encontradas.begin(), encontradas.end());
+    rutas.insert(rutas.end(), encontradas.begin(), encontradas.end());
+    return true;
+}
+
+// Nombre del archivo sin directorio ni extensión
+string nombreBase(const string &ruta) {
+    size_t barra = ruta.find_last_of("/\\");
+    string nombre = barra == string::npos ? ruta : ruta.substr(barra + 1);
+    size_t punto = nombre.find_last_of('.');
+    return punto == string::npos ? nombre : nombre.substr(0, punto);
+}
+
+struct TrabajoLote {
+    const vector<string> *rutas;
+    string salida;
+    FormatoImagen formato;
+    int ancho, alto;
+    size_t siguiente;       // próxima ruta sin tomar, protegida por candado
+    int fallidas;
+    mutex candado;
+};
+
+void trabajarLote(TrabajoLote *t) {
+    EscenaCompacta escena;  // se reutilizan entre archivos
+    Lienzo lienzo;
+    for (;;) {
+        size_t k;
+        {
+            lock_guard<mutex> bloqueo(t->candado);
+            if (t->siguiente >= t->rutas->size()) return;
+            k = t->siguiente++;
+        }
+        const string &ruta = (*t->rutas)[k];
+        bool ok;
+        if (terminaEn(ruta, ".txt")) {
+            ResultadoImportacion r;
+            ok = renderizarTextoEnLienzo(ruta, lienzo, t->ancho, t->alto, r);
+        } else {
+            truncarEscena(escena, 0);
+            ok = leerArchivoEscena(ruta, escena);
+            if (ok) renderizarFigurasEnLienzo(escena, 0, cantidadFiguras(escena), lienzo, t->ancho, t->alto);
+        }
+        string destino = t->salida + "/" + nombreBase(ruta) + extensionFormato(t->formato);
+        if (ok) ok = exportarImagen(lienzo, destino, t->formato);
+        if (!ok) {
+            lock_guard<mutex> bloqueo(t->candado);
+            cerr << "No se pudo renderizar " << ruta << endl;
+            t->fallidas++;
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    TrabajoLote t;
+    t.salida = ".";
+    t.formato = FORMATO_PPM;
+    t.ancho = ANCHO_VENTANA;
+    t.alto = ALTO_VENTANA;
+    t.siguiente = 0;
+    t.fallidas = 0;
+    int hilos = hilosDisponibles();
+    vector<string> rutas;
+    string rutaSesion;
+    bool tiempoOriginal = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--ancho") == 0 && i + 1 < argc) t.ancho = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--alto") == 0 && i + 1 < argc) t.alto = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--hilos") == 0 && i + 1 < argc) hilos = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--salida") == 0 && i + 1 < argc) t.salida = argv[++i];
+        else if (strcmp(argv[i], "--formato") == 0 && i + 1 < argc) {
+            string f = argv[++i];
+            if (f == "ppm") t.formato = FORMATO_PPM;
+            else if (f == "qoi") t.formato = FORMATO_QOI;
+            else if (f == "png") t.formato = FORMATO_PNG;
+            else {
+                cerr << "Formato desconocido: " << f << endl;
+                return 2;
+            }
+        }
+        else if (strcmp(argv[i], "--reproducir") == 0 && i + 1 < argc) rutaSesion = argv[++i];
+        else if (strcmp(argv[i], "--tiempo-original") == 0) tiempoOriginal = true;
+        else if (strcmp(argv[i], "--registro-cuadros") == 0 && i + 1 < argc) {
+            if (!abrirRegistroCuadros(argv[++i])) cerr << "No se pudo escribir " << argv[i] << endl;
+        } else if (argv[i][0] != '-') {
+            if (!listarDirectorio(argv[i], rutas)) rutas.push_back(argv[i]);
+        } else {
+            cerr << "Opción desconocida: " << argv[i] << endl;
+            return 2;
+        }
+    }
+    // Una sesión grabada se reproduce sola y deja el último cuadro en <salida>
+    if (!rutaSesion.empty()) {
+        bool ok = reproducirSinVentana(rutaSesion, tiempoOriginal);
+        cerrarRegistroCuadros();
+        if (!ok) {
+            cerr << "No se pudo reproducir " << rutaSesion << endl;
+            return 1;
+        }
+        string destino = t.salida + "/" + nombreBase(rutaSesion) + extensionFormato(t.formato);
+        return exportarImagen(lienzoPersistente, destino, t.formato) ? 0 : 1;
+    }
+    if (rutas.empty() || t.ancho <= 0 || t.alto <= 0) {
+        cerr << "Uso: " << argv[0] << " [--ancho N] [--alto N] [--hilos N] [--salida dir] [--formato ppm|qoi|png]"
+             << " escena|directorio..." << endl;
+        cerr << "     " << argv[0] << " [--salida dir] [--formato ppm|qoi|png] [--registro-cuadros ruta]"
+             << " [--tiempo-original] --reproducir sesion" << endl;
+        return 2;
+    }
+    t.rutas = &rutas;
+    hilos = max(1, min(hilos, (int) rutas.size()));
 
+    // El fondo en caché es compartido: se construye antes de lanzar los hilos
+    asegurarFondoLienzo(t.ancho, t.alto);
+    auto t0 = chrono::steady_clock::now();
+    vector<thread> trabajadores;
+    for (int h = 1; h < hilos; h++) trabajadores.push_back(thread(trabajarLote, &t));
+    trabajarLote(&t);
+    for (auto &th : trabajadores) th.join();
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
 
+    size_t hechas = rutas.size() - t.fallidas;
+    cout << hechas << " imágenes de " << t.ancho << "x" << t.alto << " con " << hilos << " hilos en "
+         << ms << " ms: " << (ms > 0 ? hechas / (ms / 1000) : 0) << " imágenes/s" << endl;
+    return t.fallidas == 0 ? 0 : 1;
+}
+#endif
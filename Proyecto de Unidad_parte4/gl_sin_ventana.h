@@ -0,0 +1,37 @@
+// Sustituto de GL/glut.h para compilar sin ventana (-DSIN_VENTANA).
+// Solo declara lo que usa el código compartido con la aplicación; como en ese
+// modo el destino de píxeles nunca es DESTINO_OPENGL, las llamadas no hacen nada.
+#ifndef GL_SIN_VENTANA_H
+#define GL_SIN_VENTANA_H
+
+typedef int GLint;
+typedef int GLsizei;
+typedef unsigned int GLenum;
+typedef unsigned int GLuint;
+typedef unsigned char GLubyte;
+typedef float GLfloat;
+
+#define GL_POINTS         0x0000
+#define GL_QUADS          0x0007
+#define GL_INT            0x1404
+#define GL_UNSIGNED_BYTE  0x1401
+#define GL_VERTEX_ARRAY   0x8074
+#define GL_COLOR_ARRAY    0x8076
+#define GLUT_LEFT_BUTTON    0
+#define GLUT_MIDDLE_BUTTON  1
+#define GLUT_DOWN           0
+
+inline void glBegin(GLenum) {}
+inline void glEnd() {}
+inline void glVertex2i(GLint, GLint) {}
+inline void glColor3ubv(const GLubyte *) {}
+inline void glPointSize(GLfloat) {}
+inline void glEnableClientState(GLenum) {}
+inline void glDisableClientState(GLenum) {}
+inline void glVertexPointer(GLint, GLenum, GLsizei, const void *) {}
+inline void glDrawArrays(GLenum, GLint, GLsizei) {}
+inline void glutPostRedisplay() {}
+inline void glutSetWindowTitle(const char *) {}
+inline void glutTimerFunc(unsigned int, void (*)(int), int) {}
+
+#endif
@@ -0,0 +1,1156 @@
+// Algoritmos de rasterización compartidos por las cuatro partes del proyecto.
+//
+// Cada algoritmo es una plantilla sobre el sumidero que recibe los píxeles,
+// de modo que la llamada por píxel se resuelve al compilar y se puede
+// expandir en línea. Un sumidero ofrece:
+//
+//   void fijarColor(const unsigned char rgb[3]);
+//   void empezarPuntos(int grosor);      // puntos de grosor x grosor px
+//   void punto(int x, int y);
+//   void terminarPuntos();
+//   void coordenadas(const int *xy, int n, int grosor);   // lote de puntos suelto
+//   void empezarTramos();
+//   void tramo(int y, int x0, int x1);   // fila y, columnas [x0, x1]
+//   void terminarTramos();
+//   const Rectangulo &recorte() const;   // zona que puede escribir
+//   unsigned long long emitidos() const; // puntos o píxeles enviados
+//
+// Los algoritmos usan recorte() para no generar pasos o filas que el
+// sumidero descartaría. Aquí están los sumideros que no dependen de OpenGL;
+// el de OpenGL inmediato está en sumidero_gl.h
+#ifndef RASTERIZADOR_H
+#define RASTERIZADOR_H
+
+#include <cmath>
+#include <climits>
+#include <vector>
+#include <algorithm>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define DDA_AVX2_DISPONIBLE
+#endif
+
+// Rectángulo con ambos extremos incluidos
+struct Rectangulo {
+    int x0, y0, x1, y1;
+};
+
+const Rectangulo PLANO_COMPLETO = {INT_MIN, INT_MIN, INT_MAX, INT_MAX};
+
+inline bool esPlanoCompleto(const Rectangulo &r) {
+    return r.x0 == INT_MIN && r.y0 == INT_MIN && r.x1 == INT_MAX && r.y1 == INT_MAX;
+}
+
+inline int redondearAEntero(float v) {
+    return (int) std::floor(v + 0.5f);
+}
+
+// Recorte de líneas (Liang-Barsky). Ajusta [t0, t1] a la parte de la recta
+// P0 + t*d que cumple p*t <= q
+inline bool recortarParametro(double p, double q, double &t0, double &t1) {
+    if (p == 0) return q >= 0;
+    double t = q / p;
+    if (p < 0) {
+        if (t > t1) return false;
+        t0 = std::max(t0, t);
+    } else {
+        if (t < t0) return false;
+        t1 = std::min(t1, t);
+    }
+    return true;
+}
+
+// Tramo [t0, t1] del segmento (x0,y0)-(x1,y1) dentro de r ampliado en margen
+inline bool recortarSegmento(int x0, int y0, int x1, int y1, const Rectangulo &r, double margen,
+                             double &t0, double &t1) {
+    double dx = x1 - x0, dy = y1 - y0;
+    t0 = 0;
+    t1 = 1;
+    return recortarParametro(-dx, x0 - (r.x0 - margen), t0, t1) &&
+           recortarParametro(dx, (r.x1 + margen) - x0, t0, t1) &&
+           recortarParametro(-dy, y0 - (r.y0 - margen), t0, t1) &&
+           recortarParametro(dy, (r.y1 + margen) - y0, t0, t1);
+}
+
+// Pasos [desde, hasta] de una línea de `pasos` pasos de (x0,y0) a (x1,y1)
+// cuyos puntos pueden caer dentro de r, contando el grosor y el redondeo;
+// false si ninguno. Sin recorte devuelve la línea completa
+inline bool pasosVisibles(int x0, int y0, int x1, int y1, int pasos, int grosor, const Rectangulo &r,
+                          int &desde, int &hasta) {
+    desde = 0;
+    hasta = pasos;
+    if (esPlanoCompleto(r)) return true;
+    double t0, t1;
+    if (!recortarSegmento(x0, y0, x1, y1, r, grosor / 2 + 1, t0, t1)) return false;
+    desde = std::max(0, (int) std::floor(t0 * pasos) - 1);
+    hasta = std::min(pasos, (int) std::ceil(t1 * pasos) + 1);
+    return desde <= hasta;
+}
+
+// Filas [y0, y1] que pueden escribirse dentro de r
+inline void filasVisibles(const Rectangulo &r, int &y0, int &y1) {
+    y0 = std::max(y0, r.y0);
+    y1 = std::min(y1, r.y1);
+}
+
+// Línea directa: evalúa la ecuación de la recta en cada paso del eje mayor,
+// de modo que cualquier paso se calcula sin los anteriores
+template <class S>
+void rasterizarLineaDirecta(S &s, int x0, int y0, int x1, int y1, int grosor) {
+    int dx = x1 - x0;
+    int dy = y1 - y0;
+    int pasos = std::max(std::abs(dx), std::abs(dy));
+    int desde, hasta;
+    if (!pasosVisibles(x0, y0, x1, y1, pasos, grosor, s.recorte(), desde, hasta)) return;
+
+    s.empezarPuntos(grosor);
+    // Horizontales y verticales sin aritmética flotante: la ecuación da y0 o x0
+    if (dy == 0) {
+        int paso = dx >= 0 ? 1 : -1;
+        for (int i = desde; i <= hasta; i++) s.punto(x0 + i * paso, y0);
+    } else if (dx == 0) {
+        int paso = dy >= 0 ? 1 : -1;
+        for (int i = desde; i <= hasta; i++) s.punto(x0, y0 + i * paso);
+    } else if (std::abs(dx) >= std::abs(dy)) {
+        int paso = dx >= 0 ? 1 : -1;
+        float m = dy / (float) dx;
+        for (int i = desde; i <= hasta; i++) {
+            int x = x0 + i * paso;
+            s.punto(x, redondearAEntero(m * (x - x0) + y0));
+        }
+    } else {
+        int paso = dy >= 0 ? 1 : -1;
+        float mInv = dx / (float) dy;
+        for (int i = desde; i <= hasta; i++) {
+            int y = y0 + i * paso;
+            s.punto(redondearAEntero(mInv * (y - y0) + x0), y);
+        }
+    }
+    s.terminarPuntos();
+}
+
+// Genera los n puntos de una línea DDA a partir del paso `primero`,
+// calculando cada paso i como x0 + i*inc
+typedef void (*GeneradorDDA)(float x0, float y0, float incX, float incY, int primero, int n, int *xy);
+
+inline void generarDDAEscalar(float x0, float y0, float incX, float incY, int primero, int n, int *xy) {
+    for (int i = 0; i < n; i++) {
+        xy[2 * i] = redondearAEntero(x0 + (primero + i) * incX);
+        xy[2 * i + 1] = redondearAEntero(y0 + (primero + i) * incY);
+    }
+}
+
+#ifdef DDA_AVX2_DISPONIBLE
+// 8 pasos por iteración; mismo redondeo que redondearAEntero
+__attribute__((target("avx2")))
+inline void generarDDAAVX2(float x0, float y0, float incX, float incY, int primero, int n, int *xy) {
+    const __m256 indices = _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f);
+    const __m256 medio = _mm256_set1_ps(0.5f);
+    const __m256 vx0 = _mm256_set1_ps(x0), vy0 = _mm256_set1_ps(y0);
+    const __m256 vincX = _mm256_set1_ps(incX), vincY = _mm256_set1_ps(incY);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 vi = _mm256_add_ps(_mm256_set1_ps((float) (primero + i)), indices);
+        __m256 x = _mm256_add_ps(vx0, _mm256_mul_ps(vi, vincX));
+        __m256 y = _mm256_add_ps(vy0, _mm256_mul_ps(vi, vincY));
+        __m256i xi = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_add_ps(x, medio)));
+        __m256i yi = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_add_ps(y, medio)));
+        __m256i bajo = _mm256_unpacklo_epi32(xi, yi);
+        __m256i alto = _mm256_unpackhi_epi32(xi, yi);
+        _mm256_storeu_si256((__m256i *) (xy + 2 * i), _mm256_permute2x128_si256(bajo, alto, 0x20));
+        _mm256_storeu_si256((__m256i *) (xy + 2 * i + 8), _mm256_permute2x128_si256(bajo, alto, 0x31));
+    }
+    for (; i < n; i++) {
+        xy[2 * i] = redondearAEntero(x0 + (primero + i) * incX);
+        xy[2 * i + 1] = redondearAEntero(y0 + (primero + i) * incY);
+    }
+}
+#endif
+
+inline GeneradorDDA elegirGeneradorDDA() {
+#ifdef DDA_AVX2_DISPONIBLE
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return generarDDAAVX2;
+#endif
+    return generarDDAEscalar;
+}
+
+inline GeneradorDDA generadorDDA() {
+    static const GeneradorDDA generador = elegirGeneradorDDA();
+    return generador;
+}
+
+// Los puntos de la DDA se generan por bloques y se entregan de una vez
+const int PUNTOS_POR_BLOQUE_DDA = 512;
+
+template <class S>
+void rasterizarLineaDDA(S &s, int x0, int y0, int x1, int y1, int grosor) {
+    int dx = x1 - x0, dy = y1 - y0;
+    int pasos = std::max(std::abs(dx), std::abs(dy));
+    float incX = pasos ? dx / (float) pasos : 0.f;
+    float incY = pasos ? dy / (float) pasos : 0.f;
+    int desde, hasta;
+    if (!pasosVisibles(x0, y0, x1, y1, pasos, grosor, s.recorte(), desde, hasta)) return;
+    GeneradorDDA generar = generadorDDA();
+    int xy[2 * PUNTOS_POR_BLOQUE_DDA];
+    for (int i = desde; i <= hasta; i += PUNTOS_POR_BLOQUE_DDA) {
+        int n = std::min(PUNTOS_POR_BLOQUE_DDA, hasta - i + 1);
+        generar(x0, y0, incX, incY, i, n, xy);
+        s.coordenadas(xy, n, grosor);
+    }
+}
+
+// Bresenham con aritmética entera; cubre los 8 octantes
+template <class S>
+void rasterizarLineaBresenham(S &s, int x0, int y0, int x1, int y1, int grosor) {
+    int dx = std::abs(x1 - x0), dy = std::abs(y1 - y0);
+    int sx = x0 < x1 ? 1 : -1;
+    int sy = y0 < y1 ? 1 : -1;
+    int desde, hasta;
+    if (!pasosVisibles(x0, y0, x1, y1, std::max(dx, dy), grosor, s.recorte(), desde, hasta)) return;
+    // Tras `desde` pasos el eje menor avanzó round(desde * menor / mayor),
+    // con los empates hacia abajo; el error se deduce de la posición
+    long long mx, my;
+    if (dx >= dy) {
+        mx = desde;
+        my = dx ? (2LL * desde * dy + dx - 1) / (2LL * dx) : 0;
+    } else {
+        my = desde;
+        mx = (2LL * desde * dx + dy - 1) / (2LL * dy);
+    }
+    int err = (int) (dx - dy - mx * dy + my * dx);
+    x0 += (int) mx * sx;
+    y0 += (int) my * sy;
+    s.empezarPuntos(grosor);
+    for (int i = desde; ; i++) {
+        s.punto(x0, y0);
+        if (i == hasta) break;
+        long long e2 = 2LL * err;   // con |err| cerca de 2e9 el doble no cabe en int
+        if (e2 > -dy) {
+            err -= dy;
+            x0 += sx;
+        }
+        if (e2 < dx) {
+            err += dx;
+            y0 += sy;
+        }
+    }
+    s.terminarPuntos();
+}
+
+// DDA en punto fijo 16.16: mismo recorrido que rasterizarLineaDDA sin floats.
+// La posición va en 64 bits: x0 * 65536 solo cabe en int hasta |x0| = 32767
+template <class S>
+void rasterizarLineaDDAFijo(S &s, int x0, int y0, int x1, int y1, int grosor) {
+    int dx = x1 - x0, dy = y1 - y0;
+    int pasos = std::max(std::abs(dx), std::abs(dy));
+    if (pasos == 0) {
+        s.empezarPuntos(grosor);
+        s.punto(x0, y0);
+        s.terminarPuntos();
+        return;
+    }
+    // Incrementos redondeados; sumar 0.5 al origen convierte >> 16 en redondeo
+    int incX = (int) (((long long) dx * 65536 + (dx < 0 ? -pasos : pasos) / 2) / pasos);
+    int incY = (int) (((long long) dy * 65536 + (dy < 0 ? -pasos : pasos) / 2) / pasos);
+    int desde, hasta;
+    if (!pasosVisibles(x0, y0, x1, y1, pasos, grosor, s.recorte(), desde, hasta)) return;
+    s.empezarPuntos(grosor);
+    long long x = (long long) x0 * 65536 + 32768 + (long long) desde * incX;
+    long long y = (long long) y0 * 65536 + 32768 + (long long) desde * incY;
+    for (int i = desde; i <= hasta; i++) {
+        s.punto((int) (x >> 16), (int) (y >> 16));
+        x += incX;
+        y += incY;
+    }
+    s.terminarPuntos();
+}
+
+// Recorte de círculos y elipses. Las variables de decisión del punto medio
+// son exactas, así que el y de cada paso x de la región 1 tiene forma
+// cerrada (el mayor y con p < 0 en ese paso), y lo mismo el x de cada paso y
+// de la región 2. Con ellas el recorrido empieza en cualquier paso y solo se
+// visitan los pasos con algún punto dentro del recorte.
+
+// Intervalo de pasos [desde, hasta]; vacío si desde > hasta
+struct Intervalo {
+    long long desde, hasta;
+};
+
+const long long PASO_INFINITO = LLONG_MAX / 4;
+const Intervalo TODOS_LOS_PASOS = {0, PASO_INFINITO};
+const Intervalo NINGUN_PASO = {1, 0};
+
+// Semieje máximo para el que 4 rx2 ry2 cabe en 64 bits; con semiejes mayores
+// la elipse se recorre entera
+const int MAX_SEMIEJE_RECORTE = 32767;
+
+inline Intervalo cortarIntervalo(const Intervalo &a, const Intervalo &b) {
+    Intervalo r = {std::max(a.desde, b.desde), std::min(a.hasta, b.hasta)};
+    return r;
+}
+
+// Pasos t con lo <= c + signo*t <= hi
+inline Intervalo intervaloLineal(long long c, int signo, long long lo, long long hi) {
+    Intervalo r = {signo > 0 ? lo - c : c - hi, signo > 0 ? hi - c : c - lo};
+    return r;
+}
+
+// Valores v con lo <= c + signo*v <= hi
+inline void rangoDeValores(long long c, int signo, long long lo, long long hi, long long &a, long long &b) {
+    a = signo > 0 ? lo - c : c - hi;
+    b = signo > 0 ? hi - c : c - lo;
+}
+
+// Mayor x >= 0 con x*x <= n; 0 si n < 0
+inline long long raizEntera(long long n) {
+    if (n <= 0) return 0;
+    long long x = (long long) std::sqrt((double) n);
+    while (x * x > n) x--;
+    while ((x + 1) * (x + 1) <= n) x++;
+    return x;
+}
+
+// Mayor x >= 0 con x*x*a + c < limite, o -1 si no hay
+inline long long mayorDentro(long long a, long long c, long long limite) {
+    if (c >= limite) return -1;
+    long long x = (long long) std::sqrt((double) (limite - c) / a);
+    while (x > 0 && x * x * a + c >= limite) x--;
+    while ((x + 1) * (x + 1) * a + c < limite) x++;
+    return x;
+}
+
+// Eje duplicado máximo para el que A²B² cabe en 64 bits con margen
+const long long MAX_EJE_FILA_EXACTA = 50000;
+
+// Mitad de la fila dy de la elipse de ejes duplicados (a, b): el mayor x >= 0
+// con (2x/a)² + (2dy/b)² < 1, o -1 si no hay. Hasta MAX_EJE_FILA_EXACTA es
+// exacta; con ejes mayores se calcula en coma flotante
+inline long long mitadFilaElipse(long long a, long long b, long long dy) {
+    if (a <= MAX_EJE_FILA_EXACTA && b <= MAX_EJE_FILA_EXACTA)
+        return mayorDentro(4 * b * b, 4 * dy * dy * a * a, a * a * b * b);
+    // b² - 4dy² factorizado, sin la cancelación de 1 - (2dy/b)² cerca de los polos
+    long long d = dy < 0 ? -dy : dy;
+    if (2 * d >= b) return -1;
+    double f = (double) (b - 2 * d) * (double) (b + 2 * d);
+    return (long long) std::ceil(a * std::sqrt(f) / (2.0 * b)) - 1;
+}
+
+// Corona entre las elipses de ejes duplicados (ax, ay) y (bx, by), sin hueco
+// si bx o by no son positivos; solo se recorren las filas visibles
+template <class S>
+inline void rasterizarCorona(S &s, int cx, int cy, long long ax, long long ay, long long bx, long long by) {
+    bool hueco = bx > 0 && by > 0;
+    int alto = (int) ((ay - 1) / 2);
+    int fila0 = cy - alto, fila1 = cy + alto;
+    filasVisibles(s.recorte(), fila0, fila1);
+    s.empezarTramos();
+    for (int y = fila0; y <= fila1; y++) {
+        long long dy = y - cy;
+        long long fuera = mitadFilaElipse(ax, ay, dy);
+        if (fuera < 0) continue;
+        long long dentro = hueco ? mitadFilaElipse(bx, by, dy) : -1;
+        if (dentro < 0) {
+            s.tramo(y, cx - (int) fuera, cx + (int) fuera);
+        } else {
+            if (fuera > dentro) {
+                s.tramo(y, cx - (int) fuera, cx - (int) dentro - 1);
+                s.tramo(y, cx + (int) dentro + 1, cx + (int) fuera);
+            }
+        }
+    }
+    s.terminarTramos();
+}
+
+// Ordena y une los intervalos no vacíos; devuelve cuántos quedan. Son 8
+// como mucho, así que basta una inserción
+inline int unirIntervalos(Intervalo *v, int n) {
+    int m = 0;
+    for (int i = 0; i < n; i++) {
+        if (v[i].desde > v[i].hasta) continue;
+        Intervalo actual = v[i];
+        int j = m++;
+        for (; j > 0 && v[j - 1].desde > actual.desde; j--) v[j] = v[j - 1];
+        v[j] = actual;
+    }
+    int k = 0;
+    for (int i = 0; i < m; i++) {
+        if (k > 0 && v[i].desde <= v[k - 1].hasta + 1) v[k - 1].hasta = std::max(v[k - 1].hasta, v[i].hasta);
+        else v[k++] = v[i];
+    }
+    return k;
+}
+
+// Recorte ampliado en el alcance del sello de un punto de grosor g
+inline void recorteConMargen(const Rectangulo &r, int grosor, long long &x0, long long &y0, long long &x1,
+                             long long &y1) {
+    long long m = grosor / 2 + 1;
+    x0 = (long long) r.x0 - m;
+    y0 = (long long) r.y0 - m;
+    x1 = (long long) r.x1 + m;
+    y1 = (long long) r.y1 + m;
+}
+
+// Círculo: en el paso x del octante, p = (x+1)² + y² - y - r² exacto, y el
+// y del paso es el mayor con x² + y² - y < r²
+inline long long yCirculo(long long r, long long x) {
+    long long d = r * r - x * x;     // y² - y < d  <=>  (2y - 1)² <= 4d
+    return d <= 0 ? 0 : (raizEntera(4 * d) + 1) / 2;
+}
+
+// Último paso del octante: el primer x con x >= y
+inline long long finOctante(long long r) {
+    long long a = 0, b = r;
+    while (a < b) {
+        long long m = (a + b) / 2;
+        if (m >= yCirculo(r, m)) b = m;
+        else a = m + 1;
+    }
+    return a;
+}
+
+// Pasos x con a <= yCirculo(r, x) <= b
+inline Intervalo pasosConYCirculo(long long r, long long a, long long b) {
+    Intervalo i = TODOS_LOS_PASOS;
+    if (a > r || b < 0 || a > b) return NINGUN_PASO;
+    if (a > 0) {
+        // y >= a  <=>  x² <= r² - a² + a - 1
+        long long m = r * r - a * a + a - 1;
+        if (m < 0) return NINGUN_PASO;
+        i.hasta = raizEntera(m);
+    }
+    if (b < r) {
+        long long m = r * r - (b + 1) * (b + 1) + b;
+        if (m >= 0) i.desde = raizEntera(m) + 1;
+    }
+    return i;
+}
+
+// Elipse, región 1: p1 = 4 f(x+1, y-1/2) exacto; el y del paso x es el mayor
+// con rx2 (2y - 1)² < 4 ry2 (rx2 - x²)
+inline long long yRegion1(long long rx2, long long ry2, long long x) {
+    long long d = 4 * ry2 * (rx2 - x * x);
+    return d <= 0 ? 0 : (raizEntera((d - 1) / rx2) + 1) / 2;
+}
+
+// Región 2 que empieza en (x0, y0). p2 no es 4 f(x+1/2, y-1) exacto: cada
+// paso que no avanza x le resta 8 rx2 de más, así que depende también de
+// cuántos pasos fueron así. Este es su valor en el paso (x, y)
+inline long long decisionRegion2(long long rx2, long long ry2, long long x0, long long y0, long long x,
+                                 long long y) {
+    return ry2*(2*x + 1)*(2*x + 1) + 4*rx2*(y - 1)*(y - 1) - 4*rx2*ry2 - 8*rx2*((y0 - y) - (x - x0));
+}
+
+// x del paso y de la región 2: x avanza cuando la decisión de la fila de
+// arriba no es positiva, y como la decisión crece con x es el menor x >= x0
+// con decisión positiva en y + 1
+inline long long xRegion2(long long rx2, long long ry2, long long x0, long long y0, long long y) {
+    if (y >= y0) return x0;
+    long long a = x0, paso = 1;
+    while (decisionRegion2(rx2, ry2, x0, y0, a + paso, y + 1) <= 0) {
+        a += paso;
+        paso *= 2;
+    }
+    long long b = a + paso;
+    if (decisionRegion2(rx2, ry2, x0, y0, a, y + 1) > 0) return a;
+    // decisión(a) <= 0 < decisión(b)
+    while (b - a > 1) {
+        long long m = a + (b - a) / 2;
+        if (decisionRegion2(rx2, ry2, x0, y0, m, y + 1) > 0) b = m;
+        else a = m;
+    }
+    return b;
+}
+
+// Pasos x de la región 1 con a <= y <= b
+inline Intervalo pasosConYRegion1(long long rx2, long long ry2, long long ry, long long a, long long b) {
+    Intervalo i = TODOS_LOS_PASOS;
+    if (a > ry || b < 0 || a > b) return NINGUN_PASO;
+    if (a > 0) {
+        // y >= a  <=>  4 ry2 x² < 4 rx2 ry2 - rx2 (2a - 1)²
+        long long n = 4 * rx2 * ry2 - rx2 * (2 * a - 1) * (2 * a - 1);
+        if (n <= 0) return NINGUN_PASO;
+        i.hasta = raizEntera((n - 1) / (4 * ry2));
+    }
+    if (b < ry) {
+        long long n = 4 * rx2 * ry2 - rx2 * (2 * b + 1) * (2 * b + 1);
+        if (n > 0) i.desde = raizEntera((n - 1) / (4 * ry2)) + 1;
+    }
+    return i;
+}
+
+// Pasos y de la región 2 con a <= x <= b; x no crece con y, así que son un
+// intervalo que se busca por bisección sobre xRegion2
+inline Intervalo pasosConXRegion2(long long rx2, long long ry2, long long x0, long long y0, long long a,
+                                  long long b) {
+    if (a > b || b < x0 || a > xRegion2(rx2, ry2, x0, y0, 0)) return NINGUN_PASO;
+    Intervalo i = {0, y0};
+    // Mayor y con x >= a
+    long long lo = 0, hi = y0;
+    while (lo < hi) {
+        long long m = (lo + hi + 1) / 2;
+        if (xRegion2(rx2, ry2, x0, y0, m) >= a) lo = m;
+        else hi = m - 1;
+    }
+    i.hasta = lo;
+    // Menor y con x <= b
+    lo = 0;
+    hi = y0;
+    while (lo < hi) {
+        long long m = (lo + hi) / 2;
+        if (xRegion2(rx2, ry2, x0, y0, m) <= b) hi = m;
+        else lo = m + 1;
+    }
+    i.desde = lo;
+    return i;
+}
+
+// Límites de las dos regiones de una elipse: la región 1 va de x = 0 a
+// finRegion1 y la región 2 de y = inicioRegion2 a 0, empezando en x = finRegion1 + 1
+inline void regionesElipse(long long rx2, long long ry2, long long rx, long long &finRegion1,
+                           long long &inicioRegion2) {
+    // Último x con ry2 x <= rx2 y (dx <= dy)
+    long long a = 0, b = rx;
+    while (a < b) {
+        long long m = (a + b + 1) / 2;
+        if (ry2 * m <= rx2 * yRegion1(rx2, ry2, m)) a = m;
+        else b = m - 1;
+    }
+    finRegion1 = a;
+    // El paso que cierra la región 1 baja y como mucho en 1, aunque la forma
+    // cerrada ya no valga en x = finRegion1 + 1
+    long long y = yRegion1(rx2, ry2, a);
+    long long p1 = 4*ry2*(a + 1)*(a + 1) + rx2*(2*y - 1)*(2*y - 1) - 4*rx2*ry2;
+    inicioRegion2 = p1 < 0 ? y : y - 1;
+}
+
+template <class S>
+inline void puntosCirculo(S &s, int cx, int cy, int x, int y) {
+    s.punto(cx + x, cy + y);
+    s.punto(cx - x, cy + y);
+    s.punto(cx + x, cy - y);
+    s.punto(cx - x, cy - y);
+    s.punto(cx + y, cy + x);
+    s.punto(cx - y, cy + x);
+    s.punto(cx + y, cy - x);
+    s.punto(cx - y, cy - x);
+}
+
+template <class S>
+inline void puntosElipse(S &s, int cx, int cy, int x, int y) {
+    s.punto(cx + x, cy + y);
+    s.punto(cx - x, cy + y);
+    s.punto(cx + x, cy - y);
+    s.punto(cx - x, cy - y);
+}
+
+template <class S>
+inline void tramosElipse(S &s, int cx, int cy, int x, int y) {
+    s.tramo(cy + y, cx - x, cx + x);
+    if (y > 0) s.tramo(cy - y, cx - x, cx + x);
+}
+
+// Contorno de círculo recortado: cada uno de los 8 puntos simétricos da un
+// intervalo de pasos x dentro del recorte; se recorre solo su unión
+template <class S>
+void rasterizarCirculoRecortado(S &s, int cx, int cy, int r, int grosor) {
+    long long x0, y0, x1, y1;
+    recorteConMargen(s.recorte(), grosor, x0, y0, x1, y1);
+    Intervalo pasos = {0, finOctante(r)};
+    Intervalo v[8];
+    int n = 0;
+    for (int sx = -1; sx <= 1; sx += 2)
+        for (int sy = -1; sy <= 1; sy += 2) {
+            long long a, b;
+            // (cx + sx*x, cy + sy*y)
+            rangoDeValores(cy, sy, y0, y1, a, b);
+            v[n++] = cortarIntervalo(cortarIntervalo(pasos, intervaloLineal(cx, sx, x0, x1)),
+                                     pasosConYCirculo(r, a, b));
+            // (cx + sx*y, cy + sy*x)
+            rangoDeValores(cx, sx, x0, x1, a, b);
+            v[n++] = cortarIntervalo(cortarIntervalo(pasos, intervaloLineal(cy, sy, y0, y1)),
+                                     pasosConYCirculo(r, a, b));
+        }
+    n = unirIntervalos(v, n);
+    s.empezarPuntos(grosor);
+    for (int k = 0; k < n; k++) {
+        int x = (int) v[k].desde, y = (int) yCirculo(r, x);
+        long long p = (long long) (x + 1) * (x + 1) + (long long) y * y - y - (long long) r * r;
+        while (true) {
+            puntosCirculo(s, cx, cy, x, y);
+            if (x == v[k].hasta) break;
+            x++;
+            if (p < 0) p += 2*x + 1;
+            else {
+                y--;
+                p += 2*(x - y) + 1;
+            }
+        }
+    }
+    s.terminarPuntos();
+}
+
+// Contorno de elipse recortado: intervalos de pasos x en la región 1 y de
+// pasos y en la región 2, uno por cada punto simétrico
+template <class S>
+void rasterizarElipseRecortada(S &s, int cx, int cy, int rx, int ry, int grosor) {
+    long long x0, y0, x1, y1;
+    recorteConMargen(s.recorte(), grosor, x0, y0, x1, y1);
+    long long rx2 = (long long) rx * rx, ry2 = (long long) ry * ry;
+    long long finRegion1, inicioRegion2;
+    regionesElipse(rx2, ry2, rx, finRegion1, inicioRegion2);
+    long long xRegion2Inicial = finRegion1 + 1;
+    Intervalo pasos1 = {0, finRegion1}, pasos2 = {0, inicioRegion2};
+    Intervalo v1[4], v2[4];
+    int n = 0;
+    for (int sx = -1; sx <= 1; sx += 2)
+        for (int sy = -1; sy <= 1; sy += 2) {
+            long long a, b;
+            rangoDeValores(cy, sy, y0, y1, a, b);
+            v1[n] = cortarIntervalo(cortarIntervalo(pasos1, intervaloLineal(cx, sx, x0, x1)),
+                                    pasosConYRegion1(rx2, ry2, ry, a, b));
+            rangoDeValores(cx, sx, x0, x1, a, b);
+            v2[n] = cortarIntervalo(cortarIntervalo(pasos2, intervaloLineal(cy, sy, y0, y1)),
+                                    pasosConXRegion2(rx2, ry2, xRegion2Inicial, inicioRegion2, a, b));
+            n++;
+        }
+    int n1 = unirIntervalos(v1, 4), n2 = unirIntervalos(v2, 4);
+    s.empezarPuntos(grosor);
+    for (int k = 0; k < n1; k++) {
+        long long x = v1[k].desde, y = yRegion1(rx2, ry2, x);
+        long long dx = 8*ry2*x, dy = 8*rx2*y;
+        long long p1 = 4*ry2*(x + 1)*(x + 1) + rx2*(2*y - 1)*(2*y - 1) - 4*rx2*ry2;
+        while (true) {
+            puntosElipse(s, cx, cy, (int) x, (int) y);
+            if (x == v1[k].hasta) break;
+            x++;
+            dx += 8*ry2;
+            if (p1 < 0) {
+                p1 += dx + 4*ry2;
+            } else {
+                y--;
+                dy -= 8*rx2;
+                p1 += dx - dy + 4*ry2;
+            }
+        }
+    }
+    // La región 2 va de y alto a y bajo
+    for (int k = n2 - 1; k >= 0; k--) {
+        long long y = v2[k].hasta, x = xRegion2(rx2, ry2, xRegion2Inicial, inicioRegion2, y);
+        long long dx = 8*ry2*x, dy = 8*rx2*y;
+        long long p2 = decisionRegion2(rx2, ry2, xRegion2Inicial, inicioRegion2, x, y);
+        while (true) {
+            puntosElipse(s, cx, cy, (int) x, (int) y);
+            if (y == v2[k].desde) break;
+            y--;
+            dy -= 8*rx2;
+            if (p2 > 0) {
+                p2 -= dy + 4*rx2;
+            } else {
+                x++;
+                dx += 8*ry2;
+                p2 += dx - dy + 4*rx2;
+            }
+        }
+    }
+    s.terminarPuntos();
+}
+
+// Disco recortado: solo las filas visibles, cada una con su ancho en forma
+// cerrada. Hasta el fin del octante X la fila d mide yCirculo(d); más allá,
+// el mayor x del octante con y >= d
+template <class S>
+void rasterizarCirculoRellenoRecortado(S &s, int cx, int cy, int r) {
+    const Rectangulo &z = s.recorte();
+    long long fin = finOctante(r);
+    long long filasOctante = fin <= yCirculo(r, fin) ? fin : fin - 1;
+    long long d0 = std::max((long long) -r, (long long) z.y0 - cy);
+    long long d1 = std::min((long long) r, (long long) z.y1 - cy);
+    s.empezarTramos();
+    for (long long d = d0; d <= d1; d++) {
+        long long a = d < 0 ? -d : d, mitad;
+        if (a <= filasOctante) mitad = yCirculo(r, a);
+        else mitad = std::min(fin, raizEntera((long long) r * r - a * a + a - 1));
+        s.tramo((int) (cy + d), (int) (cx - mitad), (int) (cx + mitad));
+    }
+    s.terminarTramos();
+}
+
+// Elipse rellena recortada: las filas de la región 2 miden xRegion2 y las de
+// la región 1 el mayor x de esa región con y >= la fila
+template <class S>
+void rasterizarElipseRellenaRecortada(S &s, int cx, int cy, int rx, int ry) {
+    const Rectangulo &z = s.recorte();
+    long long rx2 = (long long) rx * rx, ry2 = (long long) ry * ry;
+    long long finRegion1, inicioRegion2;
+    regionesElipse(rx2, ry2, rx, finRegion1, inicioRegion2);
+    long long d0 = std::max((long long) -ry, (long long) z.y0 - cy);
+    long long d1 = std::min((long long) ry, (long long) z.y1 - cy);
+    s.empezarTramos();
+    for (long long d = d0; d <= d1; d++) {
+        long long a = d < 0 ? -d : d, mitad;
+        if (a <= inicioRegion2) mitad = xRegion2(rx2, ry2, finRegion1 + 1, inicioRegion2, a);
+        else mitad = std::min(finRegion1, pasosConYRegion1(rx2, ry2, ry, a, ry).hasta);
+        s.tramo((int) (cy + d), (int) (cx - mitad), (int) (cx + mitad));
+    }
+    s.terminarTramos();
+}
+
+// Con recorte se toma el camino recortado; sin él, o en casos degenerados,
+// el recorrido completo
+template <class S>
+inline bool recortarCirculo(const S &s, int r) {
+    return !esPlanoCompleto(s.recorte()) && r > 0;
+}
+
+template <class S>
+inline bool recortarElipse(const S &s, int rx, int ry) {
+    return !esPlanoCompleto(s.recorte()) && rx > 0 && ry > 0 && rx <= MAX_SEMIEJE_RECORTE &&
+           ry <= MAX_SEMIEJE_RECORTE;
+}
+
+// Con recorte y algún semieje mayor que MAX_SEMIEJE_RECORTE el punto medio
+// desbordaría y recorrería pasos invisibles; la elipse se dibuja por filas
+// como corona de grosor g (la rellena, sin hueco)
+template <class S>
+inline bool elipseGrandeRecortada(const S &s, int rx, int ry) {
+    return !esPlanoCompleto(s.recorte()) && (rx > MAX_SEMIEJE_RECORTE || ry > MAX_SEMIEJE_RECORTE);
+}
+
+template <class S>
+void rasterizarCirculo(S &s, int cx, int cy, int r, int grosor) {
+    if (recortarCirculo(s, r)) {
+        rasterizarCirculoRecortado(s, cx, cy, r, grosor);
+        return;
+    }
+    int x = 0, y = r;
+    int p = 1 - r;
+    s.empezarPuntos(grosor);
+    puntosCirculo(s, cx, cy, x, y);
+    while (x < y) {
+        x++;
+        if (p < 0) p += 2*x + 1;
+        else {
+            y--;
+            p += 2*(x - y) + 1;
+        }
+        puntosCirculo(s, cx, cy, x, y);
+    }
+    s.terminarPuntos();
+}
+
+// Punto medio con enteros de 64 bits. Las variables de decisión van
+// multiplicadas por 4 para quitar los términos 0.25 y 0.5; dx = 8 ry2 x y
+// dy = 8 rx2 y se actualizan por suma, y p2 se deduce de p1 en vez de
+// evaluar la elipse, así ningún valor pasa de unos 8e18 con radios de hasta
+// 1e6. Con recorte los semiejes mayores no llegan aquí
+template <class S>
+void rasterizarElipse(S &s, int cx, int cy, int rx, int ry, int grosor) {
+    if (recortarElipse(s, rx, ry)) {
+        rasterizarElipseRecortada(s, cx, cy, rx, ry, grosor);
+        return;
+    }
+    if (elipseGrandeRecortada(s, rx, ry)) {
+        rasterizarCorona(s, cx, cy, 2LL * rx + grosor, 2LL * ry + grosor, 2LL * rx - grosor, 2LL * ry - grosor);
+        return;
+    }
+    s.empezarPuntos(grosor);
+    if (rx == 0 && ry == 0) {
+        s.punto(cx, cy);
+        s.terminarPuntos();
+        return;
+    }
+    long long x = 0, y = ry;
+    long long rx2 = (long long) rx * rx, ry2 = (long long) ry * ry;
+    long long dx = 0, dy = 8*rx2*y;
+    // p1 = 4 f(x + 1, y - 1/2), con f(x, y) = ry2 x^2 + rx2 y^2 - rx2 ry2
+    long long p1 = 4*ry2 - 4*rx2*ry + rx2;
+    while (dx <= dy) {
+        puntosElipse(s, cx, cy, (int) x, (int) y);
+        x++;
+        dx += 8*ry2;
+        if (p1 < 0) {
+            p1 += dx + 4*ry2;
+        } else {
+            y--;
+            dy -= 8*rx2;
+            p1 += dx - dy + 4*ry2;
+        }
+    }
+    // p2 = 4 f(x + 1/2, y - 1)
+    long long p2 = p1 - ry2*(4*x + 3) + rx2*(3 - 4*y);
+    while (y >= 0) {
+        puntosElipse(s, cx, cy, (int) x, (int) y);
+        y--;
+        dy -= 8*rx2;
+        if (p2 > 0) {
+            p2 -= dy + 4*rx2;
+        } else {
+            x++;
+            dx += 8*ry2;
+            p2 += dx - dy + 4*rx2;
+        }
+    }
+    s.terminarPuntos();
+}
+
+// Disco relleno: recorre el octante como rasterizarCirculo y emite un tramo
+// por fila. Las filas cy ± x salen en cada paso (x siempre avanza); las
+// filas cy ± y, en el último paso con ese y, con el mayor x alcanzado
+template <class S>
+void rasterizarCirculoRelleno(S &s, int cx, int cy, int r) {
+    if (recortarCirculo(s, r)) {
+        rasterizarCirculoRellenoRecortado(s, cx, cy, r);
+        return;
+    }
+    int x = 0, y = r;
+    int p = 1 - r;
+    s.empezarTramos();
+    while (true) {
+        if (x <= y) {
+            s.tramo(cy + x, cx - y, cx + y);
+            if (x > 0) s.tramo(cy - x, cx - y, cx + y);
+        }
+        bool ultimo = x >= y;
+        int xAnterior = x, yAnterior = y;
+        if (!ultimo) {
+            x++;
+            if (p < 0) p += 2*x + 1;
+            else {
+                y--;
+                p += 2*(x - y) + 1;
+            }
+        }
+        // Si y <= x esa fila ya salió como fila cy ± x
+        if (yAnterior > xAnterior && (ultimo || y != yAnterior)) {
+            s.tramo(cy + yAnterior, cx - xAnterior, cx + xAnterior);
+            s.tramo(cy - yAnterior, cx - xAnterior, cx + xAnterior);
+        }
+        if (ultimo) break;
+    }
+    s.terminarTramos();
+}
+
+// Elipse rellena con las mismas variables de decisión que rasterizarElipse.
+// En la región 1 una fila termina cuando y baja; en la región 2 y baja en
+// cada paso, así que cada punto es una fila
+template <class S>
+void rasterizarElipseRellena(S &s, int cx, int cy, int rx, int ry) {
+    if (recortarElipse(s, rx, ry)) {
+        rasterizarElipseRellenaRecortada(s, cx, cy, rx, ry);
+        return;
+    }
+    if (elipseGrandeRecortada(s, rx, ry)) {
+        rasterizarCorona(s, cx, cy, 2LL * rx + 1, 2LL * ry + 1, 0, 0);
+        return;
+    }
+    s.empezarTramos();
+    if (rx == 0 && ry == 0) {
+        s.tramo(cy, cx, cx);
+        s.terminarTramos();
+        return;
+    }
+    long long x = 0, y = ry;
+    long long rx2 = (long long) rx * rx, ry2 = (long long) ry * ry;
+    long long dx = 0, dy = 8*rx2*y;
+    long long p1 = 4*ry2 - 4*rx2*ry + rx2;
+    while (dx <= dy) {
+        if (p1 < 0) {
+            x++;
+            dx += 8*ry2;
+            p1 += dx + 4*ry2;
+        } else {
+            tramosElipse(s, cx, cy, (int) x, (int) y);
+            x++;
+            y--;
+            dx += 8*ry2;
+            dy -= 8*rx2;
+            p1 += dx - dy + 4*ry2;
+        }
+    }
+    // La fila pendiente de la región 1 la cierra el primer punto de la región 2
+    long long p2 = p1 - ry2*(4*x + 3) + rx2*(3 - 4*y);
+    while (y >= 0) {
+        tramosElipse(s, cx, cy, (int) x, (int) y);
+        y--;
+        dy -= 8*rx2;
+        if (p2 > 0) {
+            p2 -= dy + 4*rx2;
+        } else {
+            x++;
+            dx += 8*ry2;
+            p2 += dx - dy + 4*rx2;
+        }
+    }
+    s.terminarTramos();
+}
+
+// Trazos con grosor > 1. En vez de sellar un cuadrado de grosor x grosor en
+// cada punto, se rellena la forma del trazo por filas y cada píxel cubierto
+// se escribe una sola vez. Un píxel (x, y) está cubierto si su centro cae
+// dentro de la forma, con los bordes semiabiertos [-g/2, g/2) para que el
+// ancho sea exactamente g también en grosores pares
+
+// Restringe [xMin, xMax] a los enteros x con lo <= a*x + b < hi. Los límites
+// se cortan en coma flotante: con a casi 0 no caben en int
+inline void restringirFila(double a, double b, double lo, double hi, int &xMin, int &xMax) {
+    double desde = xMin, hasta = xMax;
+    if (a == 0) {
+        if (b < lo || b >= hi) hasta = desde - 1;
+    } else if (a > 0) {
+        desde = std::max(desde, std::ceil((lo - b) / a));
+        hasta = std::min(hasta, std::ceil((hi - b) / a) - 1);
+    } else {
+        desde = std::max(desde, std::floor((hi - b) / a) + 1);
+        hasta = std::min(hasta, std::floor((lo - b) / a));
+    }
+    if (desde > hasta) {
+        xMax = xMin - 1;
+        return;
+    }
+    xMin = (int) desde;
+    xMax = (int) hasta;
+}
+
+// Línea ancha: rectángulo de ancho g alrededor del segmento, alargado g/2 en
+// cada extremo (remate cuadrado, como el sello de los extremos)
+template <class S>
+inline void rasterizarLineaAncha(S &s, int x0, int y0, int x1, int y1, double g) {
+    double dx = x1 - x0, dy = y1 - y0;
+    double largo = std::sqrt(dx * dx + dy * dy);
+    double ux = largo > 0 ? dx / largo : 1.0, uy = largo > 0 ? dy / largo : 0.0;
+    double h = g / 2;
+    double alcance = h * (std::fabs(ux) + std::fabs(uy));
+    int fila0 = (int) std::floor(std::min(y0, y1) - alcance), fila1 = (int) std::ceil(std::max(y0, y1) + alcance);
+    int columna0 = (int) std::floor(std::min(x0, x1) - alcance), columna1 = (int) std::ceil(std::max(x0, x1) + alcance);
+    filasVisibles(s.recorte(), fila0, fila1);
+    s.empezarTramos();
+    for (int y = fila0; y <= fila1; y++) {
+        double ry = y - y0;
+        int xMin = columna0 - x0, xMax = columna1 - x0;
+        // a lo largo del segmento y a lo ancho, con x relativo a x0
+        restringirFila(ux, ry * uy, -h, largo + h, xMin, xMax);
+        restringirFila(-uy, ry * ux, -h, h, xMin, xMax);
+        if (xMin <= xMax) s.tramo(y, x0 + xMin, x0 + xMax);
+    }
+    s.terminarTramos();
+}
+
+// Anillo entre las elipses de semiejes (rx - g/2, ry - g/2) y (rx + g/2, ry + g/2);
+// con rx == ry es el anillo exacto de un círculo. Se trabaja con los ejes
+// duplicados (A = 2rx + g, ...) para que todo sea entero
+template <class S>
+inline void rasterizarAnillo(S &s, int cx, int cy, int rx, int ry, int g) {
+    rasterizarCorona(s, cx, cy, 2LL * rx + g, 2LL * ry + g, 2LL * rx - g, 2LL * ry - g);
+}
+
+// Caminos rápidos para los grosores del menú: con g constante el compilador
+// pliega las mitades y los cuadrados de cada fila
+template <class S>
+void rasterizarTrazoLinea(S &s, int x0, int y0, int x1, int y1, int grosor) {
+    switch (grosor) {
+        case 2: rasterizarLineaAncha(s, x0, y0, x1, y1, 2); break;
+        case 3: rasterizarLineaAncha(s, x0, y0, x1, y1, 3); break;
+        case 5: rasterizarLineaAncha(s, x0, y0, x1, y1, 5); break;
+        default: rasterizarLineaAncha(s, x0, y0, x1, y1, grosor); break;
+    }
+}
+
+template <class S>
+void rasterizarTrazoElipse(S &s, int cx, int cy, int rx, int ry, int grosor) {
+    switch (grosor) {
+        case 2: rasterizarAnillo(s, cx, cy, rx, ry, 2); break;
+        case 3: rasterizarAnillo(s, cx, cy, rx, ry, 3); break;
+        case 5: rasterizarAnillo(s, cx, cy, rx, ry, 5); break;
+        default: rasterizarAnillo(s, cx, cy, rx, ry, grosor); break;
+    }
+}
+
+// Sumideros
+
+// Solo cuenta: cada punto cubre grosor x grosor píxeles y cada tramo su
+// ancho. `vivos` consume las coordenadas para que no se descarte su cálculo
+struct SumideroContador {
+    unsigned long long pixeles;
+    unsigned vivos;
+    int grosor;
+
+    SumideroContador() : pixeles(0), vivos(0), grosor(1) {}
+    void fijarColor(const unsigned char *) {}
+    void empezarPuntos(int g) { grosor = g; }
+    void punto(int x, int y) {
+        vivos += (unsigned) x ^ (unsigned) y;
+        pixeles += (unsigned long long) grosor * grosor;
+    }
+    void terminarPuntos() {}
+    void coordenadas(const int *xy, int n, int g) {
+        empezarPuntos(g);
+        for (int i = 0; i < n; i++) punto(xy[2 * i], xy[2 * i + 1]);
+    }
+    void empezarTramos() {}
+    void tramo(int y, int x0, int x1) {
+        vivos += (unsigned) y;
+        if (x1 >= x0) pixeles += x1 - x0 + 1;
+    }
+    void terminarTramos() {}
+    const Rectangulo &recorte() const { return PLANO_COMPLETO; }
+    unsigned long long emitidos() const { return pixeles; }
+};
+
+// Imagen RGB de 8 bits por canal en memoria, con la fila 0 abajo como en
+// OpenGL. Los puntos replican GL_POINTS sin suavizado: un cuadrado de
+// grosor x grosor píxeles que empieza en x - grosor/2. Todo se recorta a
+// `zona`, que ya viene cortada a la imagen y es también el recorte que ven
+// los algoritmos
+struct SumideroMemoria {
+    unsigned char *pixeles;
+    int ancho, alto;
+    Rectangulo zona;
+    unsigned char color[3];
+    int grosor;
+    unsigned long long escritos;
+
+    SumideroMemoria(unsigned char *p, int an, int al, const Rectangulo &z = PLANO_COMPLETO)
+        : pixeles(p), ancho(an), alto(al), grosor(1), escritos(0) {
+        zona.x0 = std::max(z.x0, 0);
+        zona.y0 = std::max(z.y0, 0);
+        zona.x1 = std::min(z.x1, an - 1);
+        zona.y1 = std::min(z.y1, al - 1);
+        color[0] = color[1] = color[2] = 0;
+    }
+    void fijarColor(const unsigned char *rgb) {
+        color[0] = rgb[0];
+        color[1] = rgb[1];
+        color[2] = rgb[2];
+    }
+    void pintarFila(int y, int x0, int x1) {
+        unsigned char *p = &pixeles[3 * ((size_t) y * ancho + x0)];
+        for (int i = x0; i <= x1; i++, p += 3) {
+            p[0] = color[0];
+            p[1] = color[1];
+            p[2] = color[2];
+        }
+    }
+    void empezarPuntos(int g) { grosor = g; }
+    void punto(int x, int y) {
+        int x0 = std::max(x - grosor / 2, zona.x0);
+        int y0 = std::max(y - grosor / 2, zona.y0);
+        int x1 = std::min(x - grosor / 2 + grosor - 1, zona.x1);
+        int y1 = std::min(y - grosor / 2 + grosor - 1, zona.y1);
+        if (x1 < x0 || y1 < y0) return;
+        for (int j = y0; j <= y1; j++) pintarFila(j, x0, x1);
+        escritos += (unsigned long long) (x1 - x0 + 1) * (y1 - y0 + 1);
+    }
+    void terminarPuntos() {}
+    void coordenadas(const int *xy, int n, int g) {
+        grosor = g;
+        for (int i = 0; i < n; i++) punto(xy[2 * i], xy[2 * i + 1]);
+    }
+    void empezarTramos() {}
+    void tramo(int y, int x0, int x1) {
+        if (y < zona.y0 || y > zona.y1) return;
+        x0 = std::max(x0, zona.x0);
+        x1 = std::min(x1, zona.x1);
+        if (x0 > x1) return;
+        pintarFila(y, x0, x1);
+        escritos += x1 - x0 + 1;
+    }
+    void terminarTramos() {}
+    const Rectangulo &recorte() const { return zona; }
+    unsigned long long emitidos() const { return escritos; }
+};
+
+// Agrega los vértices (x, y intercalados) y sus colores a dos arreglos, listos
+// para glDrawArrays. Cada tramo se guarda como un quad de 1 px de alto que
+// cubre los centros de x0..x1. `zona` solo llega a los algoritmos como
+// recorte: no corta lo que ellos emitan
+struct SumideroVertices {
+    std::vector<int> &vertices;
+    std::vector<unsigned char> &colores;
+    Rectangulo zona;
+    unsigned char color[3];
+
+    SumideroVertices(std::vector<int> &v, std::vector<unsigned char> &c, const Rectangulo &z = PLANO_COMPLETO)
+        : vertices(v), colores(c), zona(z) {
+        color[0] = color[1] = color[2] = 0;
+    }
+    void fijarColor(const unsigned char *rgb) {
+        color[0] = rgb[0];
+        color[1] = rgb[1];
+        color[2] = rgb[2];
+    }
+    void vertice(int x, int y) {
+        vertices.push_back(x);
+        vertices.push_back(y);
+        colores.insert(colores.end(), color, color + 3);
+    }
+    void empezarPuntos(int) {}
+    void punto(int x, int y) { vertice(x, y); }
+    void terminarPuntos() {}
+    void coordenadas(const int *xy, int n, int) {
+        vertices.insert(vertices.end(), xy, xy + 2 * n);
+        for (int i = 0; i < n; i++) colores.insert(colores.end(), color, color + 3);
+    }
+    void empezarTramos() {}
+    void tramo(int y, int x0, int x1) {
+        if (x0 > x1) return;
+        vertice(x0, y);
+        vertice(x1 + 1, y);
+        vertice(x1 + 1, y + 1);
+        vertice(x0, y + 1);
+    }
+    void terminarTramos() {}
+    const Rectangulo &recorte() const { return zona; }
+    unsigned long long emitidos() const { return vertices.size() / 2; }
+};
+
+// Deja pasar a otro sumidero solo los puntos y tramos dentro de `zona`
+// (los puntos se recortan por su centro)
+template <class S>
+struct SumideroRecorte {
+    S &destino;
+    Rectangulo zona;
+
+    SumideroRecorte(S &d, const Rectangulo &z) : destino(d) {
+        const Rectangulo &r = d.recorte();
+        zona.x0 = std::max(z.x0, r.x0);
+        zona.y0 = std::max(z.y0, r.y0);
+        zona.x1 = std::min(z.x1, r.x1);
+        zona.y1 = std::min(z.y1, r.y1);
+    }
+    bool dentro(int x, int y) const {
+        return x >= zona.x0 && x <= zona.x1 && y >= zona.y0 && y <= zona.y1;
+    }
+    void fijarColor(const unsigned char *rgb) { destino.fijarColor(rgb); }
+    void empezarPuntos(int g) { destino.empezarPuntos(g); }
+    void punto(int x, int y) {
+        if (dentro(x, y)) destino.punto(x, y);
+    }
+    void terminarPuntos() { destino.terminarPuntos(); }
+    void coordenadas(const int *xy, int n, int g) {
+        int dentroXY[2 * PUNTOS_POR_BLOQUE_DDA];
+        int m = 0;
+        for (int i = 0; i < n; i++) {
+            if (!dentro(xy[2 * i], xy[2 * i + 1])) continue;
+            dentroXY[2 * m] = xy[2 * i];
+            dentroXY[2 * m + 1] = xy[2 * i + 1];
+            if (++m == PUNTOS_POR_BLOQUE_DDA) {
+                destino.coordenadas(dentroXY, m, g);
+                m = 0;
+            }
+        }
+        if (m > 0) destino.coordenadas(dentroXY, m, g);
+    }
+    void empezarTramos() { destino.empezarTramos(); }
+    void tramo(int y, int x0, int x1) {
+        if (y < zona.y0 || y > zona.y1) return;
+        x0 = std::max(x0, zona.x0);
+        x1 = std::min(x1, zona.x1);
+        if (x0 <= x1) destino.tramo(y, x0, x1);
+    }
+    void terminarTramos() { destino.terminarTramos(); }
+    const Rectangulo &recorte() const { return zona; }
+    unsigned long long emitidos() const { return destino.emitidos(); }
+};
+
+#endif
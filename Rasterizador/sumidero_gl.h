@@ -0,0 +1,40 @@
+// Sumidero de OpenGL en modo inmediato para los algoritmos de rasterizador.h.
+// Se incluye después de GL/glut.h (o de su sustituto sin ventana)
+#ifndef SUMIDERO_GL_H
+#define SUMIDERO_GL_H
+
+#include "rasterizador.h"
+
+// Los puntos van entre glBegin(GL_POINTS)/glEnd con glPointSize(grosor); cada
+// tramo es un quad de 1 px de alto que cubre los centros de x0..x1. Los lotes
+// de coordenadas se envían con un arreglo de vértices. No cuenta lo que
+// envía: un contador por punto cuesta tanto como el propio glVertex2i
+struct SumideroGL {
+    void fijarColor(const unsigned char *rgb) { glColor3ubv(rgb); }
+    void empezarPuntos(int grosor) {
+        glPointSize(grosor);
+        glBegin(GL_POINTS);
+    }
+    void punto(int x, int y) { glVertex2i(x, y); }
+    void terminarPuntos() { glEnd(); }
+    void coordenadas(const int *xy, int n, int grosor) {
+        glPointSize(grosor);
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glVertexPointer(2, GL_INT, 0, xy);
+        glDrawArrays(GL_POINTS, 0, n);
+        glDisableClientState(GL_VERTEX_ARRAY);
+    }
+    void empezarTramos() { glBegin(GL_QUADS); }
+    void tramo(int y, int x0, int x1) {
+        if (x0 > x1) return;
+        glVertex2i(x0, y);
+        glVertex2i(x1 + 1, y);
+        glVertex2i(x1 + 1, y + 1);
+        glVertex2i(x0, y + 1);
+    }
+    void terminarTramos() { glEnd(); }
+    const Rectangulo &recorte() const { return PLANO_COMPLETO; }
+    unsigned long long emitidos() const { return 0; }
+};
+
+#endif